@@ -0,0 +1,314 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/*
+
+	harness: schedulability experiments against the loaded MP2 module
+
+	usage: ./harness [-a userapp path] [-n tasks per set] [-s sets per point] [-i iterations]
+		[-p min period] [-P max period] [-u from,to,step] [-w job profile] [-r seed] [-g]
+
+	For every target utilization (percent, from -u), it generates random task sets
+	with UUniFast and log-uniform periods (ms, from -p and -P), launches one userapp
+	per task at the same time, and collects each userapp's result line:
+	admission, deadline misses and response times.
+
+	Output: CSV on stdout, one row per task set, for plotting acceptance ratio and
+	miss rate against utilization. With -g, the task sets are printed in the mp2sim
+	format instead of being run.
+
+*/
+
+#define DEFAULT_USERAPP "./userapp"
+#define DEFAULT_TASKS 4
+#define DEFAULT_SETS 5
+#define DEFAULT_ITERATION 6
+#define DEFAULT_PROFILE "cpu"
+#define DEFAULT_MIN_PERIOD 200
+#define DEFAULT_MAX_PERIOD 2000
+#define DEFAULT_UTIL_FROM 10
+#define DEFAULT_UTIL_TO 100
+#define DEFAULT_UTIL_STEP 10
+
+#define ARG_SIZE 32
+#define LINE_SIZE 256
+
+// the line userapp prints last, see RESULT_FORMAT in userapp.c
+#define RESULT_SCAN_FORMAT "result,%d,%d,%d,%d,%d,%d,%lld,%lld"
+
+typedef struct bench_task_t {
+	int cost;
+	int period;
+
+	// filled from the userapp result
+	pid_t pid;
+	FILE* output;
+	int accepted;
+	int jobs;
+	int misses;
+	long long avg_response_us;
+	long long max_response_us;
+} bench_task;
+
+// experiment settings
+static char* userapp_path = DEFAULT_USERAPP;
+static int task_num = DEFAULT_TASKS;
+static int set_num = DEFAULT_SETS;
+static int iteration = DEFAULT_ITERATION;
+static char* profile = DEFAULT_PROFILE;
+static int min_period = DEFAULT_MIN_PERIOD;
+static int max_period = DEFAULT_MAX_PERIOD;
+
+
+/*
+
+	Task Set Generation
+
+*/
+// uniform in [0, 1)
+double uniform(void){
+	return (double) rand() / ((double) RAND_MAX + 1.0);
+}
+
+// UUniFast: n utilizations summing up to total, uniformly distributed
+void uunifast(double* utils, int n, double total){
+	double sum;
+	double next_sum;
+	int i;
+
+	sum = total;
+	for(i = 1; i < n; i++){
+		next_sum = sum * pow(uniform(), 1.0 / (n - i));
+		utils[i - 1] = sum - next_sum;
+		sum = next_sum;
+	}
+	utils[n - 1] = sum;
+}
+
+// a task set at the target utilization, periods log-uniform in [min_period, max_period]
+void generate_task_set(bench_task* tasks, double* utils, double total){
+	int i;
+
+	uunifast(utils, task_num, total);
+
+	for(i = 0; i < task_num; i++){
+		memset(&tasks[i], 0, sizeof(bench_task));
+		tasks[i].period = (int) exp(log(min_period) + uniform() * (log(max_period) - log(min_period)));
+		tasks[i].cost = (int) (utils[i] * tasks[i].period + 0.5);
+		// userapp can not run a job shorter than a millisecond
+		if(tasks[i].cost < 1){
+			tasks[i].cost = 1;
+		}
+	}
+}
+
+
+/*
+
+	Launching userapp
+
+*/
+// fork & exec one userapp per task, stdout goes to a temp file read once it exits.
+// Return -1 if a task could not be launched: the ones after it are not either, the ones before still run
+int launch_task_set(bench_task* tasks){
+	char cost_arg[ARG_SIZE];
+	char period_arg[ARG_SIZE];
+	char iteration_arg[ARG_SIZE];
+	int i;
+
+	for(i = 0; i < task_num; i++){
+		tasks[i].pid = -1;
+		tasks[i].output = NULL;
+	}
+
+	for(i = 0; i < task_num; i++){
+		tasks[i].output = tmpfile();
+		if(tasks[i].output == NULL){
+			fprintf(stderr, "can not create the output file of task %d\n", i);
+			return -1;
+		}
+		fflush(stdout);
+
+		tasks[i].pid = fork();
+		if(tasks[i].pid < 0){
+			fprintf(stderr, "can not fork task %d\n", i);
+			return -1;
+		}
+		if(tasks[i].pid == 0){
+			sprintf(cost_arg, "%d", tasks[i].cost);
+			sprintf(period_arg, "%d", tasks[i].period);
+			sprintf(iteration_arg, "%d", iteration);
+
+			dup2(fileno(tasks[i].output), STDOUT_FILENO);
+			execl(userapp_path, userapp_path, cost_arg, period_arg, iteration_arg, profile, (char*) NULL);
+			// exec failed
+			_exit(1);
+		}
+	}
+	return 0;
+}
+
+// wait for every userapp launched and parse its result line
+void collect_task_set(bench_task* tasks){
+	char line[LINE_SIZE];
+	int pid;
+	int cost;
+	int period;
+	int i;
+
+	for(i = 0; i < task_num; i++){
+		if(tasks[i].output == NULL){
+			continue;
+		}
+		if(tasks[i].pid < 0){
+			fclose(tasks[i].output);
+			continue;
+		}
+		waitpid(tasks[i].pid, NULL, 0);
+
+		rewind(tasks[i].output);
+		while(fgets(line, LINE_SIZE, tasks[i].output) != NULL){
+			sscanf(line, RESULT_SCAN_FORMAT, &pid, &tasks[i].accepted, &cost, &period,
+				&tasks[i].jobs, &tasks[i].misses, &tasks[i].avg_response_us, &tasks[i].max_response_us);
+		}
+		fclose(tasks[i].output);
+	}
+}
+
+
+/*
+
+	Report
+
+*/
+void print_csv_header(void){
+	printf("utilization,set,tasks,accepted,acceptance_ratio,accepted_utilization,"
+		"jobs,misses,miss_rate,avg_response_ms,max_response_ms\n");
+}
+
+void print_csv_row(double total, int set_id, bench_task* tasks){
+	int accepted;
+	int jobs;
+	int misses;
+	double accepted_util;
+	long long response_total;
+	long long response_max;
+	int i;
+
+	accepted = 0;
+	jobs = 0;
+	misses = 0;
+	accepted_util = 0;
+	response_total = 0;
+	response_max = 0;
+
+	for(i = 0; i < task_num; i++){
+		if(!tasks[i].accepted){
+			continue;
+		}
+		accepted += 1;
+		accepted_util += (double) tasks[i].cost / tasks[i].period;
+		jobs += tasks[i].jobs;
+		misses += tasks[i].misses;
+		response_total += tasks[i].avg_response_us * tasks[i].jobs;
+		if(tasks[i].max_response_us > response_max){
+			response_max = tasks[i].max_response_us;
+		}
+	}
+
+	printf("%.2f,%d,%d,%d,%.3f,%.3f,%d,%d,%.3f,%.3f,%.3f\n", total, set_id, task_num, accepted,
+		(double) accepted / task_num, accepted_util, jobs, misses, jobs == 0 ? 0.0 : (double) misses / jobs,
+		jobs == 0 ? 0.0 : response_total / 1000.0 / jobs, response_max / 1000.0);
+	fflush(stdout);
+}
+
+// the task set in the mp2sim task set format
+void print_task_set(double total, int set_id, bench_task* tasks){
+	int i;
+
+	printf("# utilization %.2f set %d\n", total, set_id);
+	for(i = 0; i < task_num; i++){
+		printf("%d %d\n", tasks[i].cost, tasks[i].period);
+	}
+}
+
+int main(int argc, char* argv[]){
+	int opt;
+	int generate_only;
+	unsigned int seed;
+	int util_from;
+	int util_to;
+	int util_step;
+	int util;
+	int set_id;
+	bench_task* tasks;
+	double* utils;
+
+	generate_only = 0;
+	seed = 1;
+	util_from = DEFAULT_UTIL_FROM;
+	util_to = DEFAULT_UTIL_TO;
+	util_step = DEFAULT_UTIL_STEP;
+
+	while((opt = getopt(argc, argv, "a:n:s:i:p:P:u:w:r:g")) != -1){
+		switch(opt){
+			case 'a': userapp_path = optarg; break;
+			case 'n': sscanf(optarg, "%d", &task_num); break;
+			case 's': sscanf(optarg, "%d", &set_num); break;
+			case 'i': sscanf(optarg, "%d", &iteration); break;
+			case 'p': sscanf(optarg, "%d", &min_period); break;
+			case 'P': sscanf(optarg, "%d", &max_period); break;
+			case 'u': sscanf(optarg, "%d,%d,%d", &util_from, &util_to, &util_step); break;
+			case 'w': profile = optarg; break;
+			case 'r': sscanf(optarg, "%u", &seed); break;
+			case 'g': generate_only = 1; break;
+			default:
+				printf("usage: ./harness [-a userapp path] [-n tasks per set] [-s sets per point] [-i iterations]\n"
+					"\t[-p min period] [-P max period] [-u from,to,step] [-w job profile] [-r seed] [-g]\n");
+				return 1;
+		}
+	}
+
+	if(task_num < 1 || set_num < 1 || util_step < 1 || min_period < 1 || max_period < min_period){
+		printf("invalid settings\n");
+		return 1;
+	}
+
+	// the same seed gives the same task sets
+	srand(seed);
+	tasks = malloc(task_num * sizeof(bench_task));
+	utils = malloc(task_num * sizeof(double));
+
+	if(!generate_only){
+		print_csv_header();
+	}
+
+	for(util = util_from; util <= util_to; util += util_step){
+		for(set_id = 0; set_id < set_num; set_id++){
+			generate_task_set(tasks, utils, util / 100.0);
+
+			if(generate_only){
+				print_task_set(util / 100.0, set_id, tasks);
+				continue;
+			}
+
+			if(launch_task_set(tasks) < 0){
+				// the tasks already running are waited for, the set is left out of the results
+				collect_task_set(tasks);
+				fprintf(stderr, "task set %d at utilization %.2f skipped\n", set_id, util / 100.0);
+				continue;
+			}
+			collect_task_set(tasks);
+			print_csv_row(util / 100.0, set_id, tasks);
+		}
+	}
+
+	free(utils);
+	free(tasks);
+	return 0;
+}
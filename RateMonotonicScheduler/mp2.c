@@ -1,6 +1,7 @@
 #define LINUX
 
 #include "mp2_given.h"
+#include "mp2_core.h"
 
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -14,6 +15,7 @@
 #include <linux/spinlock.h>
 #include <linux/jiffies.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("ziangw2");
@@ -22,11 +24,14 @@ MODULE_DESCRIPTION("CS-423 MP2");
 // proc file system names & globals
 #define PROC_DIR_NAME "mp2"
 #define PROC_FILE_NAME "status"
+#define PROC_QUERY_FILE_NAME "query"
 
-#define PROC_READ_BUF_SIZE 2048
+// the status file is sized by its lines, a process line with every field at its widest fits in one
+#define STATUS_LINE_SIZE 256
 
 static struct proc_dir_entry *mp2_proc_dir = NULL;
 static struct proc_dir_entry *mp2_proc_entry = NULL;
+static struct proc_dir_entry *mp2_query_entry = NULL;
 
 // the flag used to handle proc_read
 #define UNREAD 0
@@ -36,48 +41,57 @@ static struct proc_dir_entry *mp2_proc_entry = NULL;
 #define REGIST_CMD_FORMAT "R,%d,%u,%u"
 #define YIELD_CMD_FORMAT "Y,%d"
 #define DEREGIST_CMD_FORMAT "D,%d"
-
-// register, deregister: linked list entry
-typedef struct mp2_list_entry_t {
-	struct list_head head;
-
-	struct task_struct* pcb_pt;
-
-	int state; // run 0, ready 1, sleep 2
-	int pid;
-
-	// keep these in jiffies
-	unsigned long period;
-	unsigned long next_period;
-	unsigned long cost;
-
-	// compute once
-	unsigned int load;
-	
-	// the timer used by yield
-	struct timer_list wakeup_timer;
-} mp2_list_entry;
-// struct access macros
-#define list_head_ptr(entry) ( &(entry->head) )
+#define REGIST_GROUP_CMD_FORMAT "G,%d,%u,%u"
+#define JOIN_GROUP_CMD_FORMAT "J,%d,%d"
+#define DEREGIST_GROUP_CMD_FORMAT "GD,%d"
+#define REGIST_CHILD_CMD_FORMAT "C,%d,%d,%u,%u"
+#define REGIST_PARALLEL_CMD_FORMAT "P,%d,%u,%u"
+#define JOIN_PARALLEL_CMD_FORMAT "W,%d,%d,%u"
+#define MODE_CHANGE_CMD_FORMAT "M,%d,%u,%u"
+#define POLICY_CMD_FORMAT "O,%d,%7s"
+#define POLICY_NAME_SIZE 8
+#define OFFSET_CMD_FORMAT "E,%d,%d,%u"
+#define START_CMD_FORMAT "T,%d"
+#define PREFAULT_REGION_CMD_FORMAT "L,%d,%lx,%lu"
+#define PREFAULT_CMD_FORMAT "L,%d"
+
+// query file: write "cost,period", read back "admit,remaining load,max cost at that period"
+#define QUERY_CMD_FORMAT "%u,%u"
+#define QUERY_REPLY_FORMAT "%d,%u,%u\n"
+#define QUERY_REPLY_SIZE 64
+
+// struct access macros, the entries themselves live in mp2_core.h
 #define pcb_ptr(entry) ( entry->pcb_pt )
 #define timer_ptr(entry) ( &(entry->wakeup_timer) )
 
-// the state of the process
-#define STATE_RUNNING_CODE 	0
-#define STATE_RUNNING_STR	"running"
-#define STATE_READY_CODE 	1
-#define STATE_READY_STR		"ready"
-#define STATE_SLEEPING_CODE	2
-#define STATE_SLEEPING_STR 	"sleeping"
-
 // the mp2 linked list & list lock
 static mp2_list_entry* regist_head = NULL;
 static spinlock_t list_lock;
+// the group reservations, also guarded by list_lock
+static mp2_group* group_head = NULL;
+// the cores taken by heavy parallel tasks, also guarded by list_lock
+static struct cpumask dedicated_cpus;
+
+// what a task had before it got pinned to dedicated cores or kept off them, put back when its entry goes
+typedef struct mp2_saved_sched_t {
+	struct list_head head;
+	struct task_struct* task;
+	cpumask_var_t cpus;
+	// heavy parallel workers also get SCHED_FIFO 99 for good, shared tasks are switched by the dispatch thread
+	int pinned;
+	int policy;
+	struct sched_param sparam;
+} mp2_saved_sched;
 
-// admission control global & helper macro
+// the last query written on an open query file, kept in file->private_data
+typedef struct mp2_query_t {
+	int valid;
+	unsigned int cost;
+	unsigned int period;
+} mp2_query;
+
+// admission control global
 static unsigned int current_load = 0;
-// to immitate \sigma{c/p} < 0.693 ==> 1000*c/p < 693, +1 to make the condition a little stricter
-#define compute_load(cost, period) ((1000 * cost / period) + 1)
 
 // scheduling globals
 static mp2_list_entry* running_process_pt = NULL;
@@ -93,7 +107,9 @@ static struct task_struct* dispath_thread_pcb_pt = NULL;
 	PCB Augmentation and Linked List
 
 */
-// used in register_process, invoked when the timer wakes up (real time job comes)
+// used in register_process, invoked when the timer wakes up (real time job comes). No list_lock in
+// timer context: yield_process stops the timer before it changes the state, and an aborted job only
+// changes it after its deadline timer fired
 void _timer_func(unsigned long entry_pt){
 	mp2_list_entry* this_entry;
 
@@ -103,12 +119,393 @@ void _timer_func(unsigned long entry_pt){
 	printk(KERN_ALERT "timer_func called for [%d]\n", this_entry->pid);
 	#endif
 
-	// set to ready and invoke the dispatch thread
-	this_entry->state = STATE_READY_CODE;
+	if(this_entry->state == STATE_SLEEPING_CODE){
+		// release: set to ready, the same timer then watches the deadline of this job
+		this_entry->state = STATE_READY_CODE;
+		mod_timer(timer_ptr(this_entry), this_entry->next_period + this_entry->period);
+	}else{
+		// the deadline passed with the job unfinished, the dispatch thread applies the overload policy
+		this_entry->miss_pending = 1;
+	}
+
+	// invoke the dispatch thread
 	wake_up_process(dispath_thread_pcb_pt);
 	// NOTE: no need to call schedule() here, will also lead to a BUG
 }
 
+// used in register_group, invoked at every period boundary of the group
+void _group_period_func(unsigned long group_pt){
+	mp2_group* this_group;
+
+	this_group = (mp2_group*) group_pt;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "group period_func called for [%d]\n", this_group->tgid);
+	#endif
+
+	// the dispatch thread refills the budget and releases the members
+	this_group->release_pending = 1;
+
+	// periods missed while the timer was late are skipped, like a late job in yield
+	this_group->next_period = compute_next_period(this_group->next_period, this_group->period, jiffies);
+	mod_timer(&this_group->period_timer, this_group->next_period);
+
+	wake_up_process(dispath_thread_pcb_pt);
+}
+
+// used in register_group, invoked when the running member used up the group budget
+void _group_budget_func(unsigned long group_pt){
+	// the dispatch thread charges the running member and throttles the group
+	wake_up_process(dispath_thread_pcb_pt);
+}
+
+// a member gets dispatched: start counting & arm the budget timer
+void _group_start(mp2_list_entry* member){
+	mp2_group* this_group;
+
+	this_group = member->group;
+	this_group->run_start = jiffies;
+	mod_timer(&this_group->budget_timer, jiffies + this_group->budget);
+}
+
+// a member stops running: the budget is not consumed any more
+void _group_stop(mp2_list_entry* member){
+	del_timer(&member->group->budget_timer);
+}
+
+// the first yield of any member or child starts the group's periods, immediately released
+void _group_start_periods(mp2_group* this_group){
+	if(this_group->next_period == 0){
+		this_group->next_period = jiffies;
+		mod_timer(&this_group->period_timer, this_group->next_period);
+	}
+}
+
+// a worker of a parallel task joined, list_lock held
+void _parallel_worker_join(mp2_group* task){
+	if(!parallel_worker_done(task)){
+		return;
+	}
+
+	if(task->next_period == 0){
+		// every worker is in place: start the periods, the first release is immediate
+		_group_start_periods(task);
+	}else if(time_after(jiffies, task->job_release + task->period)){
+		// the last worker joined after the deadline
+		task->miss_count += 1;
+	}
+}
+
+// a member finished its share of the job, list_lock held
+void _group_member_yield(mp2_list_entry* member){
+	if(member->group->workers != 0){
+		// parallel task: the job is complete when the last worker yields
+		_parallel_worker_join(member->group);
+		member->next_period = member->group->next_period;
+		return;
+	}
+
+	_group_start_periods(member->group);
+
+	// non-zero: this member waits for the next group release
+	member->next_period = member->group->next_period;
+}
+
+// the shortest period among the children of a server, 0 if it has none, list_lock held
+void _update_min_child_period(mp2_group* server){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+
+	server->min_child_period = 0;
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->group != server || !this_process->own_release){
+			continue;
+		}
+
+		if(server->min_child_period == 0 || this_process->period < server->min_child_period){
+			server->min_child_period = this_process->period;
+		}
+		// both periods count while a mode change is pending
+		if(this_process->mode_pending && this_process->mode_period < server->min_child_period){
+			server->min_child_period = this_process->mode_period;
+		}
+	}
+}
+
+// the next period boundary of a task with a pending mode change came, list_lock held
+void _apply_mode_change(mp2_list_entry* entry){
+	unsigned int reserved;
+
+	reserved = reserved_load(entry);
+	apply_mode_change(entry);
+
+	// give back the part of the transition reservation the new mode does not need
+	if(entry->group == NULL){
+		current_load = current_load - reserved + entry->load;
+	}else{
+		entry->group->child_load = entry->group->child_load - reserved + entry->load;
+		_update_min_child_period(entry->group);
+	}
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "mode change applied to [%d] period [%lu] cost [%lu]\n", entry->pid, entry->period, entry->cost);
+	#endif
+}
+
+// find the group reservation of a thread group, list_lock held
+mp2_group* _find_group(int tgid){
+	struct list_head* pos;
+	mp2_group* this_group;
+
+	list_for_each(pos, list_head_ptr(group_head)){
+		this_group = (mp2_group*) pos;
+		if(this_group->tgid == tgid){
+			return this_group;
+		}
+	}
+
+	return NULL;
+}
+
+// the task of pid with a reference for the entry, so the status file & the dispatch thread can still
+// read it after the task exits without deregistering. NULL if there is no such task
+struct task_struct* _get_task(int pid){
+	struct task_struct* task;
+
+	rcu_read_lock();
+	task = find_task_by_pid(pid);
+	if(task != NULL){
+		get_task_struct(task);
+	}
+	rcu_read_unlock();
+
+	return task;
+}
+
+// drop the reference of an entry about to be freed
+void _put_entry_task(mp2_list_entry* entry){
+	if(pcb_ptr(entry) != NULL){
+		put_task_struct(pcb_ptr(entry));
+		entry->pcb_pt = NULL;
+	}
+}
+
+// remember the fault counters at admission, the status file reports the faults taken since then
+void _init_fault_base(mp2_list_entry* entry){
+	entry->resident_pages = 0;
+	if(pcb_ptr(entry) != NULL){
+		entry->min_flt_base = pcb_ptr(entry)->min_flt;
+		entry->maj_flt_base = pcb_ptr(entry)->maj_flt;
+	}else{
+		entry->min_flt_base = 0;
+		entry->maj_flt_base = 0;
+	}
+}
+
+// a saved state to fill in under list_lock, allocated before since it may sleep, NULL if out of memory
+mp2_saved_sched* _alloc_saved_sched(void){
+	mp2_saved_sched* saved;
+
+	saved = kmalloc(sizeof(mp2_saved_sched), GFP_KERNEL);
+	if(saved == NULL){
+		return NULL;
+	}
+	if(!alloc_cpumask_var(&saved->cpus, GFP_KERNEL)){
+		kfree(saved);
+		return NULL;
+	}
+	saved->task = NULL;
+	return saved;
+}
+
+void _free_saved_sched(mp2_saved_sched* saved){
+	if(saved->task != NULL){
+		put_task_struct(saved->task);
+	}
+	free_cpumask_var(saved->cpus);
+	kfree(saved);
+}
+
+// remember the affinity & policy of the task of entry before the module moves it, list_lock held
+void _save_sched(mp2_list_entry* entry, mp2_saved_sched* saved, int pinned){
+	saved->task = pcb_ptr(entry);
+	get_task_struct(saved->task);
+	cpumask_copy(saved->cpus, tsk_cpus_allowed(saved->task));
+	saved->pinned = pinned;
+	saved->policy = saved->task->policy;
+	saved->sparam.sched_priority = saved->task->rt_priority;
+	entry->saved = saved;
+}
+
+// an entry is about to be freed, queue what its task had on restore, list_lock held
+void _detach_sched(mp2_list_entry* entry, struct list_head* restore){
+	if(entry->saved != NULL){
+		list_add(&entry->saved->head, restore);
+		entry->saved = NULL;
+	}
+}
+
+// put the tasks of the freed entries back on their affinity & policy, without list_lock since it may sleep
+void _restore_sched(struct list_head* restore){
+	struct list_head* pos;
+	struct list_head* temp;
+	mp2_saved_sched* saved;
+
+	list_for_each_safe(pos, temp, restore){
+		saved = (mp2_saved_sched*) pos;
+		list_del(pos);
+
+		#ifndef ECHO_TEST
+		if(pid_alive(saved->task)){
+			set_cpus_allowed_ptr(saved->task, saved->cpus);
+			if(saved->pinned){
+				sched_setscheduler(saved->task, saved->policy, &saved->sparam);
+			}
+		}
+		#endif
+
+		_free_saved_sched(saved);
+	}
+}
+
+// a worker of a task with dedicated cores not pinned yet, the caller holds list_lock
+int _unpinned_worker(mp2_list_entry* entry){
+	return entry->group != NULL && entry->group->cores != 0 && pcb_ptr(entry) != NULL && entry->saved == NULL;
+}
+
+// heavy parallel workers run at SCHED_FIFO on the dedicated cores of their task,
+// set up from process context since changing the affinity may sleep
+void _pin_parallel_worker(int pid){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	mp2_saved_sched* saved;
+	struct task_struct* task;
+	cpumask_var_t cpus;
+	struct sched_param sparam;
+	int found;
+
+	if(cpumask_empty(&dedicated_cpus)){
+		return;
+	}
+
+	// every yield comes through here, allocate only for a worker still to pin
+	found = 0;
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == pid){
+			found = _unpinned_worker(this_process);
+			break;
+		}
+	}
+	spin_unlock(&list_lock);
+	if(!found){
+		return;
+	}
+
+	if(!alloc_cpumask_var(&cpus, GFP_KERNEL)){
+		return;
+	}
+	saved = _alloc_saved_sched();
+	if(saved == NULL){
+		free_cpumask_var(cpus);
+		return;
+	}
+
+	task = NULL;
+
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid != pid){
+			continue;
+		}
+
+		// checked again, the lock was dropped to allocate. pinned once, the saved state is what it had before
+		if(_unpinned_worker(this_process)){
+			_save_sched(this_process, saved, 1);
+			saved = NULL;
+			task = pcb_ptr(this_process);
+			get_task_struct(task);
+			cpumask_copy(cpus, &this_process->group->cpus);
+		}
+		break;
+	}
+	spin_unlock(&list_lock);
+
+	if(saved != NULL){
+		_free_saved_sched(saved);
+	}
+
+	if(task != NULL){
+		#ifndef ECHO_TEST
+		set_cpus_allowed_ptr(task, cpus);
+		sparam.sched_priority = 99;
+		sched_setscheduler(task, SCHED_FIFO, &sparam);
+		#endif
+
+		put_task_struct(task);
+	}
+	free_cpumask_var(cpus);
+}
+
+// keep the shared domain off the cores dedicated to heavy parallel tasks, within the affinity the task had
+// before it was first narrowed, so it gets the cores back once they are released
+void _pin_shared(mp2_list_entry* entry){
+	mp2_saved_sched* saved;
+	struct task_struct* task;
+	cpumask_var_t shared;
+	bool narrow;
+
+	task = pcb_ptr(entry);
+	if(task == NULL){
+		return;
+	}
+
+	// never narrowed and nothing dedicated: it keeps its own affinity
+	saved = NULL;
+	if(entry->saved == NULL){
+		if(cpumask_empty(&dedicated_cpus)){
+			return;
+		}
+		saved = _alloc_saved_sched();
+		if(saved == NULL){
+			return;
+		}
+	}
+	if(!alloc_cpumask_var(&shared, GFP_KERNEL)){
+		if(saved != NULL){
+			_free_saved_sched(saved);
+		}
+		return;
+	}
+
+	spin_lock(&list_lock);
+	if(entry->saved == NULL && saved != NULL){
+		_save_sched(entry, saved, 0);
+		saved = NULL;
+	}
+	narrow = entry->saved != NULL;
+	if(narrow){
+		cpumask_andnot(shared, entry->saved->cpus, &dedicated_cpus);
+		// its own cores are all dedicated: leave them, rather than nowhere to run
+		if(cpumask_empty(shared)){
+			cpumask_copy(shared, entry->saved->cpus);
+		}
+	}
+	spin_unlock(&list_lock);
+
+	if(saved != NULL){
+		_free_saved_sched(saved);
+	}
+
+	if(narrow && !cpumask_equal(tsk_cpus_allowed(task), shared)){
+		set_cpus_allowed_ptr(task, shared);
+	}
+	free_cpumask_var(shared);
+}
+
 // register a new process, linked list insert
 void register_process(int* pid_int_pt, unsigned int* period_ms_pt, unsigned int* comput_cost_ms_pt){
 	mp2_list_entry* new_entry;
@@ -123,11 +520,23 @@ void register_process(int* pid_int_pt, unsigned int* period_ms_pt, unsigned int*
 	// init the new entry
 	new_entry = kmalloc(sizeof(mp2_list_entry), GFP_KERNEL);
 	new_entry->pid = *pid_int_pt;
-	new_entry->pcb_pt = find_task_by_pid(new_entry->pid);
+	new_entry->pcb_pt = _get_task(new_entry->pid);
+	new_entry->saved = NULL;
 	new_entry->state = STATE_SLEEPING_CODE;
 	new_entry->period = msecs_to_jiffies(*period_ms_pt);
 	new_entry->next_period = 0; // set after first yield
 	new_entry->cost = msecs_to_jiffies(*comput_cost_ms_pt);
+	new_entry->group = NULL;
+	new_entry->own_release = 1;
+	new_entry->mode_pending = 0;
+	new_entry->start_set = 0;
+	new_entry->offset = 0;
+	new_entry->epoch = 0;
+	new_entry->start_waiting = 0;
+	new_entry->policy = OVERLOAD_SKIP;
+	new_entry->miss_pending = 0;
+	memset(new_entry->miss_count, 0, sizeof(new_entry->miss_count));
+	_init_fault_base(new_entry);
 
 	// set up timer
 	setup_timer(timer_ptr(new_entry), _timer_func, (unsigned long) new_entry);
@@ -141,8 +550,9 @@ void register_process(int* pid_int_pt, unsigned int* period_ms_pt, unsigned int*
 	#endif
 
 	// admission control
-	if(this_load + current_load > 693){
+	if(!admit_load(current_load, this_load)){
 		// admission denied
+		_put_entry_task(new_entry);
 		kfree(new_entry);
 
 		#ifdef DEBUG
@@ -170,133 +580,928 @@ void yield_process(int* pid_int_pt){
 	printk(KERN_ALERT "yield process [%d]\n", *pid_int_pt);
 	#endif
 
+	// may sleep, so before the list lock & before the task state changes
+	_pin_parallel_worker(*pid_int_pt);
+
 	spin_lock(&list_lock);
 	// list traversal, it is a for loop
 	list_for_each(pos, list_head_ptr(regist_head) ){
 		this_process = (mp2_list_entry*) pos;
 
-		// yielding this
+		// yielding this, workers of a parallel task still being declared keep running
 		if(this_process->pid == *pid_int_pt){
+			if(this_process->group != NULL && !this_process->group->admitted){
+				break;
+			}
+
+			// the deadline timer reads the state without list_lock: let a firing finish (a miss right at the
+			// deadline is then pending) and keep it from seeing the yield half done, it is re-armed below
+			del_timer_sync(timer_ptr(this_process));
+
 			// terminate if it is running
 			this_process->state = STATE_SLEEPING_CODE;
 			if(running_process_pt == this_process){
+				if(this_process->group != NULL){
+					group_charge(this_process->group, jiffies);
+					_group_stop(this_process);
+				}
+				running_process_pt = NULL;
+			}
+
+			// calculate and set the next timer
+			if(!this_process->own_release){
+				// group member: released together with the rest of the group
+				_group_member_yield(this_process);
+			}else if(this_process->next_period == 0 && this_process->start_set != 0){
+				// in a start set: the first release is at epoch + offset, or waits for the start command
+				if(this_process->epoch != 0){
+					this_process->next_period = first_release(this_process->epoch, this_process->offset,
+						this_process->period, jiffies);
+				}else{
+					this_process->start_waiting = 1;
+				}
+				if(this_process->group != NULL){
+					_group_start_periods(this_process->group);
+				}
+			}else{
+				// newly registered: immediately ready, otherwise per the overload policy of the task
+				this_process->next_period = overload_next_period(this_process, jiffies);
+				// the phase is kept: the new mode starts with the release at this boundary
+				if(this_process->mode_pending){
+					_apply_mode_change(this_process);
+				}
+				// server child: its jobs only run while the server has budget
+				if(this_process->group != NULL){
+					_group_start_periods(this_process->group);
+				}
+			}
+
+			// set the timer to wake up for the next period
+			if(this_process->own_release && !this_process->start_waiting){
+				mod_timer(timer_ptr(this_process), this_process->next_period);
+			}
+
+			// set this process to sleeping
+			#ifndef ECHO_TEST
+			set_task_state(pcb_ptr(this_process), TASK_UNINTERRUPTIBLE);
+			#endif
+
+			break;
+		}	
+	}
+
+	spin_unlock(&list_lock);
+
+	// wake up the dispatch thread to schedule a new job
+	wake_up_process(dispath_thread_pcb_pt);
+	schedule();
+}
+
+// deregister
+void deregister_process(int* pid_int_pt){
+	struct list_head* pos;
+	struct list_head* temp;
+	mp2_list_entry* this_process;
+	LIST_HEAD(restore);
+	bool schedule_another;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "deregister_process [%d]\n", *pid_int_pt);
+	#endif
+
+	schedule_another = false;
+
+	spin_lock( &list_lock );
+
+	// safe traversal with memory freed
+	list_for_each_safe(pos, temp, list_head_ptr(regist_head) ){
+		this_process = (mp2_list_entry*) pos;
+
+		if(this_process->pid == *pid_int_pt){
+			// load decreasing, group members & server children are covered by the group reservation
+			if(this_process->group == NULL){
+				current_load -= reserved_load(this_process);
+			}
+			// stop the timer
+			del_timer(timer_ptr(this_process));
+			if(this_process->group != NULL){
+				this_process->group->member_count -= 1;
+				// the parallel job does not wait for a worker that left in the middle of it
+				if(this_process->group->admitted && this_process->group->workers != 0
+					&& this_process->state != STATE_SLEEPING_CODE){
+					_parallel_worker_join(this_process->group);
+				}
+			}
+			// schedule another process if the current running one stopped
+			if(running_process_pt == this_process){
+				if(this_process->group != NULL){
+					group_charge(this_process->group, jiffies);
+					_group_stop(this_process);
+				}
 				running_process_pt = NULL;
+				schedule_another = true;
 			}
+			// remove from  the linked list
+			list_del(pos);
+			// a server child frees its share of the server, nothing changes globally
+			if(this_process->group != NULL && this_process->own_release){
+				this_process->group->child_load -= reserved_load(this_process);
+				_update_min_child_period(this_process->group);
+			}
+
+			#ifdef DEBUG
+			printk(KERN_ALERT "remove pid [%d] afterwards current load [%u]\n", this_process->pid, current_load);
+			#endif
+
+			_detach_sched(this_process, &restore);
+			_put_entry_task(this_process);
+			kfree(this_process);
+			break;
+		}
+	}
+
+	spin_unlock( &list_lock );
+
+	_restore_sched(&restore);
+
+	if(schedule_another){
+		wake_up_process(dispath_thread_pcb_pt);
+		schedule();
+	}
+}
+
+// retune the period & cost of a live process: admitted atomically against everything else,
+// applied at its next period boundary, the old parameters stay if it does not fit
+void change_mode(int* pid_int_pt, unsigned int* period_ms_pt, unsigned int* comput_cost_ms_pt){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	unsigned long new_period;
+	unsigned int new_load;
+	unsigned int reserved;
+	unsigned int transition;
+	bool admitted;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "mode change [%d] to period [%u] cost [%u]\n", *pid_int_pt, *period_ms_pt, *comput_cost_ms_pt);
+	#endif
+
+	if(*period_ms_pt == 0 || *comput_cost_ms_pt > *period_ms_pt){
+		return;
+	}
+
+	new_period = msecs_to_jiffies(*period_ms_pt);
+	new_load = compute_load(*comput_cost_ms_pt, *period_ms_pt);
+	admitted = false;
+
+	spin_lock(&list_lock);
+
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid != *pid_int_pt){
+			continue;
+		}
+
+		// group threads & parallel workers follow their reservation, they have no mode of their own
+		if(!this_process->own_release){
+			break;
+		}
+
+		// until the boundary both modes may be in effect, so the larger load is held meanwhile
+		reserved = reserved_load(this_process);
+		transition = transition_load(this_process, new_load);
+		if(this_process->group == NULL){
+			admitted = admit_load(current_load - reserved, transition);
+			if(admitted){
+				current_load = current_load - reserved + transition;
+			}
+		}else{
+			this_process->group->child_load -= reserved;
+			admitted = admit_child(this_process->group, new_period, transition);
+			this_process->group->child_load += admitted ? transition : reserved;
+		}
+
+		if(admitted){
+			this_process->mode_pending = 1;
+			this_process->mode_period = new_period;
+			this_process->mode_cost = msecs_to_jiffies(*comput_cost_ms_pt);
+			this_process->mode_load = new_load;
+			if(this_process->group != NULL){
+				_update_min_child_period(this_process->group);
+			}
+		}
+		break;
+	}
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "mode change [%d] %s, current load [%u]\n", *pid_int_pt, admitted ? "admitted" : "denied", current_load);
+	#endif
+
+	spin_unlock(&list_lock);
+}
+
+// select what happens to the jobs of a process that are still running at their deadline
+void set_overload_policy(int* pid_int_pt, char* policy_name){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	int policy;
+
+	policy = overload_policy_code(policy_name);
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "overload policy of [%d] to [%s]\n", *pid_int_pt, overload_policy_str(policy));
+	#endif
+
+	if(policy < 0){
+		return;
+	}
+
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		// only tasks released by their own timer have deadlines of their own
+		if(this_process->pid == *pid_int_pt && this_process->own_release){
+			this_process->policy = policy;
+			break;
+		}
+	}
+	spin_unlock(&list_lock);
+}
+
+// put a process in a start set with a release offset, before its first release
+void set_release_offset(int* pid_int_pt, int* set_int_pt, unsigned int* offset_ms_pt){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	mp2_list_entry* found;
+	unsigned long epoch;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "release offset of [%d] set [%d] offset [%u]\n", *pid_int_pt, *set_int_pt, *offset_ms_pt);
+	#endif
+
+	if(*set_int_pt <= 0){
+		return;
+	}
+
+	found = NULL;
+	epoch = 0;
+
+	spin_lock(&list_lock);
+
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == *pid_int_pt){
+			found = this_process;
+		}
+		// joining a set that already started: same epoch
+		if(this_process->start_set == *set_int_pt && this_process->epoch != 0){
+			epoch = this_process->epoch;
+		}
+	}
+
+	// only tasks with their own releases, and only before the first one
+	if(found != NULL && found->own_release && found->next_period == 0 && !found->start_waiting){
+		found->start_set = *set_int_pt;
+		found->offset = msecs_to_jiffies(*offset_ms_pt);
+		found->epoch = epoch;
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// start a set: one epoch for all its tasks, every task that already yielded gets its first release armed
+void start_release_set(int* set_int_pt){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	unsigned long epoch;
+
+	epoch = jiffies;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "start set [%d] at [%lu]\n", *set_int_pt, epoch);
+	#endif
+
+	spin_lock(&list_lock);
+
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		// a set starts once
+		if(this_process->start_set != *set_int_pt || this_process->epoch != 0){
+			continue;
+		}
+
+		this_process->epoch = epoch;
+		if(this_process->start_waiting){
+			this_process->start_waiting = 0;
+			this_process->next_period = epoch + this_process->offset;
+			mod_timer(timer_ptr(this_process), this_process->next_period);
+		}
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// allocate a group reservation, not in the list yet
+mp2_group* _alloc_group(int id, unsigned long period, unsigned long cost){
+	mp2_group* new_group;
+
+	new_group = kmalloc(sizeof(mp2_group), GFP_KERNEL);
+	new_group->tgid = id;
+	new_group->member_count = 0;
+	new_group->child_load = 0;
+	new_group->min_child_period = 0;
+	new_group->period = period;
+	new_group->next_period = 0; // set after the first member yields
+	new_group->cost = cost;
+	new_group->load = 0;
+	new_group->budget = 0;
+	new_group->run_start = 0;
+	new_group->release_pending = 0;
+	new_group->workers = 0;
+	new_group->span = 0;
+	new_group->cores = 0;
+	new_group->pending = 0;
+	new_group->admitted = 1;
+	new_group->job_release = 0;
+	new_group->job_count = 0;
+	new_group->throttle_count = 0;
+	new_group->used_total = 0;
+	new_group->miss_count = 0;
+	cpumask_clear(&new_group->cpus);
+
+	setup_timer(&new_group->period_timer, _group_period_func, (unsigned long) new_group);
+	setup_timer(&new_group->budget_timer, _group_budget_func, (unsigned long) new_group);
+
+	return new_group;
+}
+
+// register a group reservation shared by threads of one process, admitted like a single process
+void register_group(int* tgid_int_pt, unsigned int* period_ms_pt, unsigned int* comput_cost_ms_pt){
+	mp2_group* new_group;
+	unsigned int this_load;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "insert group [%d] with period [%u] cost [%u]\n", *tgid_int_pt, *period_ms_pt, *comput_cost_ms_pt);
+	#endif
+
+	new_group = _alloc_group(*tgid_int_pt, msecs_to_jiffies(*period_ms_pt), msecs_to_jiffies(*comput_cost_ms_pt));
+
+	this_load = compute_load(*comput_cost_ms_pt, *period_ms_pt);
+	new_group->load = this_load;
+
+	spin_lock(&list_lock);
+
+	// admission control, one reservation per thread group
+	if(!admit_load(current_load, this_load) || _find_group(new_group->tgid) != NULL){
+		kfree(new_group);
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "insert group denied with current load [%u] this load [%u]\n", current_load, this_load);
+		#endif
+	}else{
+		list_add(list_head_ptr(new_group), list_head_ptr(group_head));
+		current_load += this_load;
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "group inserted at [%p] after insert current load [%u]\n", new_group, current_load);
+		#endif
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// add a thread to its process' group reservation, no admission needed: it shares the group budget
+void join_group(int* tgid_int_pt, int* pid_int_pt){
+	mp2_list_entry* new_entry;
+	mp2_list_entry* this_process;
+	mp2_group* this_group;
+	struct list_head* pos;
+	bool denied;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "join [%d] to group [%d]\n", *pid_int_pt, *tgid_int_pt);
+	#endif
+
+	new_entry = kmalloc(sizeof(mp2_list_entry), GFP_KERNEL);
+	new_entry->pid = *pid_int_pt;
+	new_entry->pcb_pt = _get_task(new_entry->pid);
+	new_entry->saved = NULL;
+	new_entry->state = STATE_SLEEPING_CODE;
+	new_entry->next_period = 0; // set after first yield
+	new_entry->load = 0;
+	new_entry->own_release = 0;
+	new_entry->mode_pending = 0;
+	new_entry->start_set = 0;
+	new_entry->offset = 0;
+	new_entry->epoch = 0;
+	new_entry->start_waiting = 0;
+	new_entry->policy = OVERLOAD_SKIP;
+	new_entry->miss_pending = 0;
+	memset(new_entry->miss_count, 0, sizeof(new_entry->miss_count));
+	_init_fault_base(new_entry);
+	setup_timer(timer_ptr(new_entry), _timer_func, (unsigned long) new_entry);
+
+	spin_lock(&list_lock);
+
+	// only threads of the reserving process may join, and only once
+	this_group = _find_group(*tgid_int_pt);
+	denied = this_group == NULL || this_group->workers != 0
+		|| pcb_ptr(new_entry) == NULL || pcb_ptr(new_entry)->tgid != *tgid_int_pt;
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == new_entry->pid){
+			denied = true;
+			break;
+		}
+	}
+
+	if(denied){
+		_put_entry_task(new_entry);
+		kfree(new_entry);
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "join [%d] denied\n", *pid_int_pt);
+		#endif
+	}else{
+		// members share the group's priority
+		new_entry->group = this_group;
+		new_entry->period = this_group->period;
+		new_entry->cost = this_group->cost;
+		list_add(list_head_ptr(new_entry), list_head_ptr(regist_head));
+		this_group->member_count += 1;
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// add a child task to a tenant server, admitted against the server budget only:
+// the global load does not change, so tenants can add & remove tasks on their own
+void register_child(int* sid_int_pt, int* pid_int_pt, unsigned int* period_ms_pt, unsigned int* comput_cost_ms_pt){
+	mp2_list_entry* new_entry;
+	mp2_list_entry* this_process;
+	mp2_group* this_group;
+	struct list_head* pos;
+	bool denied;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "insert child [%d] to server [%d] with period [%u] cost [%u]\n", *pid_int_pt, *sid_int_pt,
+		*period_ms_pt, *comput_cost_ms_pt);
+	#endif
+
+	new_entry = kmalloc(sizeof(mp2_list_entry), GFP_KERNEL);
+	new_entry->pid = *pid_int_pt;
+	new_entry->pcb_pt = _get_task(new_entry->pid);
+	new_entry->saved = NULL;
+	new_entry->state = STATE_SLEEPING_CODE;
+	new_entry->period = msecs_to_jiffies(*period_ms_pt);
+	new_entry->next_period = 0; // set after first yield
+	new_entry->cost = msecs_to_jiffies(*comput_cost_ms_pt);
+	new_entry->load = compute_load(*comput_cost_ms_pt, *period_ms_pt);
+	new_entry->own_release = 1;
+	new_entry->mode_pending = 0;
+	new_entry->start_set = 0;
+	new_entry->offset = 0;
+	new_entry->epoch = 0;
+	new_entry->start_waiting = 0;
+	new_entry->policy = OVERLOAD_SKIP;
+	new_entry->miss_pending = 0;
+	memset(new_entry->miss_count, 0, sizeof(new_entry->miss_count));
+	_init_fault_base(new_entry);
+	setup_timer(timer_ptr(new_entry), _timer_func, (unsigned long) new_entry);
+
+	spin_lock(&list_lock);
+
+	// compositional admission against the server, each pid only once
+	this_group = _find_group(*sid_int_pt);
+	denied = this_group == NULL || this_group->workers != 0 || !admit_child(this_group, new_entry->period, new_entry->load);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == new_entry->pid){
+			denied = true;
+			break;
+		}
+	}
+
+	if(denied){
+		_put_entry_task(new_entry);
+		kfree(new_entry);
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "insert child [%d] denied\n", *pid_int_pt);
+		#endif
+	}else{
+		new_entry->group = this_group;
+		list_add(list_head_ptr(new_entry), list_head_ptr(regist_head));
+		this_group->member_count += 1;
+		this_group->child_load += new_entry->load;
+		if(this_group->min_child_period == 0 || new_entry->period < this_group->min_child_period){
+			this_group->min_child_period = new_entry->period;
+		}
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "child inserted at [%p] server [%d] child load [%u]\n", new_entry, this_group->tgid,
+			this_group->child_load);
+		#endif
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// remove a group reservation together with all its members, list_lock held, their saved states go on
+// restore. Return true if the running process was one of them
+bool _remove_group(mp2_group* this_group, struct list_head* restore){
+	struct list_head* pos;
+	struct list_head* temp;
+	mp2_list_entry* this_process;
+	bool schedule_another;
+
+	schedule_another = false;
+
+	// drop the members first
+	list_for_each_safe(pos, temp, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->group != this_group){
+			continue;
+		}
+
+		del_timer(timer_ptr(this_process));
+		if(running_process_pt == this_process){
+			running_process_pt = NULL;
+			schedule_another = true;
+		}else if(this_process->next_period != 0){
+			// members waiting for a release would sleep forever
+			#ifndef ECHO_TEST
+			wake_up_process(pcb_ptr(this_process));
+			#endif
+		}
+		list_del(pos);
+		_detach_sched(this_process, restore);
+		_put_entry_task(this_process);
+		kfree(this_process);
+	}
+
+	current_load -= this_group->load;
+	cpumask_andnot(&dedicated_cpus, &dedicated_cpus, &this_group->cpus);
+	del_timer(&this_group->period_timer);
+	del_timer(&this_group->budget_timer);
+	list_del(list_head_ptr(this_group));
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "remove group [%d] afterwards current load [%u]\n", this_group->tgid, current_load);
+	#endif
+
+	kfree(this_group);
+	return schedule_another;
+}
+
+// deregister a group reservation together with all its members
+void deregister_group(int* tgid_int_pt){
+	mp2_group* this_group;
+	LIST_HEAD(restore);
+	bool schedule_another;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "deregister_group [%d]\n", *tgid_int_pt);
+	#endif
+
+	schedule_another = false;
+
+	spin_lock(&list_lock);
+
+	this_group = _find_group(*tgid_int_pt);
+	if(this_group != NULL){
+		schedule_another = _remove_group(this_group, &restore);
+	}
+
+	spin_unlock(&list_lock);
+
+	_restore_sched(&restore);
+
+	if(schedule_another){
+		wake_up_process(dispath_thread_pcb_pt);
+		schedule();
+	}
+}
+
+/*
+	Parallel tasks: P,id,period,workers declares a fork-join task, then W,id,tid,cost declares each
+	worker thread with the cost of its segment. The task is admitted with the federated test once the
+	last worker is declared, and every job releases all the workers together.
+*/
+// take n cores for a heavy parallel task, cpu 0 always stays in the shared domain, list_lock held
+bool _reserve_cores(mp2_group* task, unsigned int n){
+	unsigned int taken;
+	int cpu;
+
+	if((int) n > (int) num_online_cpus() - 1 - (int) cpumask_weight(&dedicated_cpus)){
+		return false;
+	}
+
+	cpumask_clear(&task->cpus);
+	taken = 0;
+	for_each_online_cpu(cpu){
+		if(taken == n){
+			break;
+		}
+		if(cpu == 0 || cpumask_test_cpu(cpu, &dedicated_cpus)){
+			continue;
+		}
+		cpumask_set_cpu(cpu, &task->cpus);
+		taken += 1;
+	}
+	cpumask_or(&dedicated_cpus, &dedicated_cpus, &task->cpus);
+
+	return true;
+}
+
+// federated admission once every worker is declared, list_lock held, return false if rejected
+bool _admit_parallel(mp2_group* task){
+	unsigned int cores;
+
+	cores = federated_cores(task->cost, task->span, task->period);
+	if(cores == FEDERATED_INFEASIBLE){
+		return false;
+	}
+
+	if(cores == 0){
+		// light: runs sequentially under its own budget in the shared domain
+		task->load = compute_load(jiffies_to_msecs(task->cost), jiffies_to_msecs(task->period));
+		if(!admit_load(current_load, task->load)){
+			task->load = 0;
+			return false;
+		}
+		current_load += task->load;
+	}else if(!_reserve_cores(task, cores)){
+		return false;
+	}
+
+	task->cores = cores;
+	task->admitted = 1;
+	// the first round of yields only tells that every worker is in place
+	task->pending = task->member_count;
+	return true;
+}
+
+// declare a parallel task with its period and number of workers, admitted later
+void register_parallel(int* id_int_pt, unsigned int* period_ms_pt, unsigned int* workers_pt){
+	mp2_group* new_task;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "insert parallel [%d] with period [%u] workers [%u]\n", *id_int_pt, *period_ms_pt, *workers_pt);
+	#endif
+
+	new_task = _alloc_group(*id_int_pt, msecs_to_jiffies(*period_ms_pt), 0);
+	new_task->workers = *workers_pt;
+	new_task->admitted = 0;
+
+	spin_lock(&list_lock);
+
+	if(new_task->workers == 0 || _find_group(new_task->tgid) != NULL){
+		kfree(new_task);
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "insert parallel [%d] denied\n", *id_int_pt);
+		#endif
+	}else{
+		list_add(list_head_ptr(new_task), list_head_ptr(group_head));
+	}
+
+	spin_unlock(&list_lock);
+}
+
+// declare one worker thread of a parallel task with the cost of its segment
+void join_parallel(int* id_int_pt, int* tid_int_pt, unsigned int* comput_cost_ms_pt){
+	mp2_list_entry* new_entry;
+	mp2_list_entry* this_process;
+	mp2_group* this_task;
+	struct list_head* pos;
+	LIST_HEAD(restore);
+	bool denied;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "worker [%d] of parallel [%d] with cost [%u]\n", *tid_int_pt, *id_int_pt, *comput_cost_ms_pt);
+	#endif
+
+	new_entry = kmalloc(sizeof(mp2_list_entry), GFP_KERNEL);
+	new_entry->pid = *tid_int_pt;
+	new_entry->pcb_pt = _get_task(new_entry->pid);
+	new_entry->saved = NULL;
+	// ready to join: not dispatchable before the first release refills the budget
+	new_entry->state = STATE_READY_CODE;
+	new_entry->next_period = 0;
+	new_entry->cost = msecs_to_jiffies(*comput_cost_ms_pt);
+	new_entry->load = 0;
+	new_entry->own_release = 0;
+	new_entry->mode_pending = 0;
+	new_entry->start_set = 0;
+	new_entry->offset = 0;
+	new_entry->epoch = 0;
+	new_entry->start_waiting = 0;
+	new_entry->policy = OVERLOAD_SKIP;
+	new_entry->miss_pending = 0;
+	memset(new_entry->miss_count, 0, sizeof(new_entry->miss_count));
+	_init_fault_base(new_entry);
+	setup_timer(timer_ptr(new_entry), _timer_func, (unsigned long) new_entry);
+
+	spin_lock(&list_lock);
+
+	this_task = _find_group(*id_int_pt);
+	denied = this_task == NULL || this_task->workers == 0 || this_task->admitted || new_entry->cost == 0;
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == new_entry->pid){
+			denied = true;
+			break;
+		}
+	}
+
+	if(denied){
+		_put_entry_task(new_entry);
+		kfree(new_entry);
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "worker [%d] denied\n", *tid_int_pt);
+		#endif
+	}else{
+		new_entry->group = this_task;
+		new_entry->period = this_task->period;
+		list_add(list_head_ptr(new_entry), list_head_ptr(regist_head));
+		this_task->member_count += 1;
+		this_task->cost += new_entry->cost;
+		if(new_entry->cost > this_task->span){
+			this_task->span = new_entry->cost;
+		}
+
+		// the last worker: admit the whole task or drop it
+		if(this_task->member_count == this_task->workers && !_admit_parallel(this_task)){
+			#ifdef DEBUG
+			printk(KERN_ALERT "parallel [%d] denied with work [%lu] span [%lu]\n", this_task->tgid,
+				this_task->cost, this_task->span);
+			#endif
+
+			_remove_group(this_task, &restore);
+		}
+	}
+
+	spin_unlock(&list_lock);
+
+	_restore_sched(&restore);
+}
+
+// release every worker of a parallel task together, list_lock held
+void _parallel_release(mp2_group* task){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+
+	if(task->pending != 0){
+		// the last job has not joined yet, no new job on top of it
+		return;
+	}
+
+	group_refill(task);
+	task->pending = task->member_count;
+	task->job_release = jiffies;
+
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->group != task){
+			continue;
+		}
+
+		if(task->cores == 0){
+			// light: the dispatch thread runs the workers one at a time under the budget
+			this_process->state = STATE_READY_CODE;
+		}else{
+			// heavy: straight onto the dedicated cores
+			this_process->state = STATE_RUNNING_CODE;
+			#ifndef ECHO_TEST
+			wake_up_process(pcb_ptr(this_process));
+			#endif
+		}
+	}
+}
+
+// refill & release the groups whose period came and charge the running member,
+// return true if the running member used up its group budget
+bool update_groups(void){
+	struct list_head* pos;
+	struct list_head* member_pos;
+	mp2_group* this_group;
+	mp2_list_entry* this_process;
+	bool throttle;
 
-			// calculate and set the next timer
-			if(this_process->next_period == 0){
-				// newly registered, immediately ready
-				this_process->next_period = jiffies;
-			}else{
-				// finished job, if no missing jobs, this loop will only run once
-				while(this_process->next_period <= jiffies){
-					this_process->next_period += this_process->period;
-				}	
-			}
+	spin_lock(&list_lock);
 
-			// set the timer to wake up for the next period
-			mod_timer(timer_ptr(this_process), this_process->next_period);
+	// charge first, so the used time goes to the period it belongs to
+	if(running_process_pt != NULL && running_process_pt->group != NULL){
+		group_charge(running_process_pt->group, jiffies);
+	}
 
-			// set this process to sleeping
-			#ifndef ECHO_TEST
-			set_task_state(pcb_ptr(this_process), TASK_UNINTERRUPTIBLE);
-			#endif
+	list_for_each(pos, list_head_ptr(group_head)){
+		this_group = (mp2_group*) pos;
+		if(!this_group->release_pending){
+			continue;
+		}
 
-			break;
-		}	
+		this_group->release_pending = 0;
+		if(this_group->workers != 0){
+			_parallel_release(this_group);
+			continue;
+		}
+		group_refill(this_group);
+
+		// release the members that finished the last job, server children have their own timers
+		list_for_each(member_pos, list_head_ptr(regist_head)){
+			this_process = (mp2_list_entry*) member_pos;
+			if(this_process->group == this_group && !this_process->own_release
+				&& this_process->state == STATE_SLEEPING_CODE && this_process->next_period != 0){
+				this_process->state = STATE_READY_CODE;
+			}
+		}
+	}
+
+	throttle = false;
+	if(running_process_pt != NULL && running_process_pt->group != NULL
+		&& running_process_pt->group->budget == 0){
+		running_process_pt->group->throttle_count += 1;
+		_group_stop(running_process_pt);
+		throttle = true;
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "group [%d] out of budget\n", running_process_pt->group->tgid);
+		#endif
 	}
 
 	spin_unlock(&list_lock);
 
-	// wake up the dispatch thread to schedule a new job
-	wake_up_process(dispath_thread_pcb_pt);
-	schedule();
+	return throttle;
 }
 
-// deregister
-void deregister_process(int* pid_int_pt){
+// apply the overload policy of every job whose deadline passed unfinished, count the miss under that policy,
+// return true if the running process got aborted
+bool update_deadlines(void){
 	struct list_head* pos;
-	struct list_head* temp;
 	mp2_list_entry* this_process;
-	bool schedule_another;
-
-	#ifdef DEBUG
-	printk(KERN_ALERT "deregister_process [%d]\n", *pid_int_pt);
-	#endif
+	bool abort_running;
 
-	schedule_another = false;
+	abort_running = false;
 
-	spin_lock( &list_lock );
+	spin_lock(&list_lock);
 
-	// safe traversal with memory freed
-	list_for_each_safe(pos, temp, list_head_ptr(regist_head) ){
+	list_for_each(pos, list_head_ptr(regist_head)){
 		this_process = (mp2_list_entry*) pos;
+		if(!this_process->miss_pending){
+			continue;
+		}
 
-		if(this_process->pid == *pid_int_pt){
-			// load decreasing
-			current_load -= this_process->load;
-			// stop the timer
-			del_timer(timer_ptr(this_process));
-			// schedule another process if the current running one stopped
-			if(running_process_pt == this_process){
-				running_process_pt = NULL;
-				schedule_another = true;
-			}
-			// remove from  the linked list
-			list_del(pos);
+		this_process->miss_pending = 0;
+		this_process->miss_count[this_process->policy] += 1;
 
-			#ifdef DEBUG
-			printk(KERN_ALERT "remove pid [%d] afterwards current load [%u]\n", this_process->pid, current_load);
+		// the job finished in the meantime, only the miss counts
+		if(this_process->state == STATE_SLEEPING_CODE){
+			continue;
+		}
+
+		if(this_process->policy == OVERLOAD_SIGNAL){
+			#ifndef ECHO_TEST
+			if(pcb_ptr(this_process) != NULL){
+				send_sig(SIGXCPU, pcb_ptr(this_process), 1);
+			}
 			#endif
+		}else if(this_process->policy == OVERLOAD_ABORT){
+			if(running_process_pt == this_process){
+				if(this_process->group != NULL){
+					group_charge(this_process->group, jiffies);
+					_group_stop(this_process);
+				}
+				abort_running = true;
+			}
 
-			kfree(this_process);
-			break;
+			// no cpu until the next period boundary, where the task gets a fresh release
+			this_process->state = STATE_SLEEPING_CODE;
+			this_process->next_period = compute_next_period(this_process->next_period, this_process->period, jiffies);
+			mod_timer(timer_ptr(this_process), this_process->next_period);
 		}
+
+		#ifdef DEBUG
+		printk(KERN_ALERT "deadline miss [%d] policy [%s]\n", this_process->pid, overload_policy_str(this_process->policy));
+		#endif
 	}
 
-	spin_unlock( &list_lock );
+	spin_unlock(&list_lock);
 
-	if(schedule_another){
-		wake_up_process(dispath_thread_pcb_pt);
-		schedule();
-	}
+	return abort_running;
 }
 
 // util func: get the ready process with the highest priority
 mp2_list_entry* get_highest_prio_ready_proc(void){
-	unsigned long smallest_period;
-	mp2_list_entry* this_process;
 	mp2_list_entry* ret_pt;
-	struct list_head* pos;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "get_highest_prio_ready_proc called\n");
 	#endif
 
 	spin_lock(&list_lock);
-	smallest_period = 0;
-
-	ret_pt = NULL;
-	// list traversal, it is a for loop
-	list_for_each(pos, list_head_ptr(regist_head) ){
-		this_process = (mp2_list_entry*) pos;
-
-		// ready one
-		if(this_process->state == STATE_READY_CODE){
-			if(smallest_period == 0){
-				// first ready process
-				smallest_period = this_process->period;
-				ret_pt = this_process;
-			}else{
-				// comparison needed
-				if(this_process->period < smallest_period){
-					smallest_period = this_process->period;
-					ret_pt = this_process;
-				}
-			}
-		}	
-	}
-
+	ret_pt = pick_highest_prio_ready(regist_head);
 	spin_unlock(&list_lock);
 
 	#ifdef DEBUG
@@ -310,6 +1515,24 @@ mp2_list_entry* get_highest_prio_ready_proc(void){
 	return ret_pt;
 }
 
+// room for a line per group & per process, the ones registered before read_all_registered are cut off
+size_t _status_buf_len(void){
+	struct list_head* pos;
+	size_t lines;
+
+	lines = 0;
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(group_head)){
+		lines += 1;
+	}
+	list_for_each(pos, list_head_ptr(regist_head)){
+		lines += 1;
+	}
+	spin_unlock(&list_lock);
+
+	return lines * STATUS_LINE_SIZE + 1;
+}
+
 // read all the current registered process, into the buffer, return the num of bytes read
 ssize_t read_all_registered(char* buf, size_t buf_len){
 	char* temp;
@@ -317,6 +1540,7 @@ ssize_t read_all_registered(char* buf, size_t buf_len){
 	ssize_t total;
 	struct list_head* pos;
 	mp2_list_entry* this_process;
+	mp2_group* this_group;
 	int printed_len;
 	char* state_str;
 
@@ -330,11 +1554,44 @@ ssize_t read_all_registered(char* buf, size_t buf_len){
 	temp = buf;
 	remain_len = buf_len;
 	total = 0;
+	// nothing registered prints nothing
+	buf[0] = '\0';
+
+	// group reservations: tgid,group,cost,period,members,jobs,throttled,used,child load,child capacity
+	// parallel tasks: id,parallel,work,period,workers,jobs,misses,span,cores
+	list_for_each(pos, list_head_ptr(group_head) ){
+		this_group = (mp2_group*) pos;
+
+		// scnprintf leaves the terminating byte, a full buffer has 1 byte left
+		if(remain_len <= 1){
+			break;
+		}
+
+		if(this_group->workers != 0){
+			printed_len = scnprintf(temp, remain_len, "%d,parallel,%lu,%lu,%u,%lu,%lu,%lu,%u\n", this_group->tgid,
+				this_group->cost, this_group->period, this_group->member_count, this_group->job_count,
+				this_group->miss_count, this_group->span, this_group->cores);
+		}else{
+			printed_len = scnprintf(temp, remain_len, "%d,group,%lu,%lu,%u,%lu,%lu,%lu,%u,%u\n", this_group->tgid,
+				this_group->cost, this_group->period, this_group->member_count, this_group->job_count,
+				this_group->throttle_count, this_group->used_total, this_group->child_load,
+				server_capacity(this_group, this_group->min_child_period == 0 ? this_group->period : this_group->min_child_period));
+		}
+
+		total += printed_len;
+		temp += printed_len;
+		remain_len -= printed_len;
+	}
 
 	// list traversal, it is a for loop
 	list_for_each(pos, list_head_ptr(regist_head) ){
 		this_process = (mp2_list_entry*) pos;
 
+		// the group lines may have filled the buffer already
+		if(remain_len <= 1){
+			break;
+		}
+
 		// use snprintf, defined in linux/kernel.h, not worried about flip page
 		if(this_process->state == STATE_SLEEPING_CODE){
 			state_str = STATE_SLEEPING_STR;
@@ -344,18 +1601,20 @@ ssize_t read_all_registered(char* buf, size_t buf_len){
 			state_str = STATE_RUNNING_STR;
 		}
 
-		printed_len = snprintf(temp, remain_len, "%d,%s,%lu,%lu\n", this_process->pid, state_str,
-			this_process->cost, this_process->period);
+		// pid,state,cost,period,minor faults & major faults since admission,resident pages,
+		// overload policy,deadline misses under skip,late,abort,signal
+		printed_len = scnprintf(temp, remain_len, "%d,%s,%lu,%lu,%lu,%lu,%lu,%s,%lu,%lu,%lu,%lu\n", this_process->pid, state_str,
+			this_process->cost, this_process->period,
+			pcb_ptr(this_process) == NULL ? 0 : pcb_ptr(this_process)->min_flt - this_process->min_flt_base,
+			pcb_ptr(this_process) == NULL ? 0 : pcb_ptr(this_process)->maj_flt - this_process->maj_flt_base,
+			this_process->resident_pages, overload_policy_str(this_process->policy),
+			this_process->miss_count[OVERLOAD_SKIP], this_process->miss_count[OVERLOAD_LATE],
+			this_process->miss_count[OVERLOAD_ABORT], this_process->miss_count[OVERLOAD_SIGNAL]);
 		
 		// update positions
 		total += printed_len;
 		temp += printed_len;
 		remain_len -= printed_len;
-
-		// defense against buffer overflow
-		if(remain_len <= 1){
-		 	break;
-		}
 	}
 
 	spin_unlock(&list_lock);
@@ -381,6 +1640,11 @@ void init_linked_list(void){
    	INIT_LIST_HEAD( list_head_ptr(regist_head) );
    	regist_head->pid = -1;
 
+   	group_head = (mp2_group*) kmalloc(sizeof(mp2_group), GFP_KERNEL);
+   	INIT_LIST_HEAD( list_head_ptr(group_head) );
+   	group_head->tgid = -1;
+   	cpumask_clear(&dedicated_cpus);
+
    	#ifdef DEBUG
    	printk(KERN_ALERT "alloc [%p]\n", regist_head);
    	#endif
@@ -392,6 +1656,8 @@ void init_linked_list(void){
 void free_linked_list(void){
 	struct list_head* pos;
 	mp2_list_entry* this_process;
+	mp2_group* this_group;
+	LIST_HEAD(restore);
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "free_linked_list called\n");
@@ -410,6 +1676,8 @@ void free_linked_list(void){
 		printk(KERN_ALERT "free [%p]\n", this_process);
 		#endif
 
+		_detach_sched(this_process, &restore);
+		_put_entry_task(this_process);
 		kfree(this_process);
 	}
 
@@ -420,11 +1688,123 @@ void free_linked_list(void){
 	// free the list head
 	kfree(regist_head);
 
+	// the same for the group reservations
+	for(pos = list_head_ptr(group_head)->next; pos != list_head_ptr(group_head); /*increment is done in the loop body*/){
+		this_group = (mp2_group*) pos;
+		del_timer(&this_group->period_timer);
+		del_timer(&this_group->budget_timer);
+		pos = pos->next;
+
+		kfree(this_group);
+	}
+	kfree(group_head);
+
 	spin_unlock(&list_lock);
+
+	// the tasks outlive the module, give them back what they had
+	_restore_sched(&restore);
 	// static variable list_lock automatically freed after the program terminates
 }
 
 
+/*
+
+	Memory Residency
+
+*/
+// fault in every mapped page of [start, end) of the task, return the number of pages faulted in
+long _prefault_range(struct task_struct* task, struct mm_struct* mm, unsigned long start, unsigned long end){
+	struct vm_area_struct* vma;
+	unsigned long from;
+	unsigned long to;
+	long faulted;
+	long ret;
+
+	faulted = 0;
+	start &= PAGE_MASK;
+
+	down_read(&mm->mmap_sem);
+
+	for(vma = find_vma(mm, start); vma != NULL && vma->vm_start < end; vma = vma->vm_next){
+		// io mappings and guard areas can not be faulted in
+		if((vma->vm_flags & (VM_IO | VM_PFNMAP)) || !(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC))){
+			continue;
+		}
+
+		from = max(start, vma->vm_start);
+		to = min(PAGE_ALIGN(end), vma->vm_end);
+
+		// write faults for writable mappings, so copy on write is resolved now as well
+		ret = get_user_pages(task, mm, from, (to - from) >> PAGE_SHIFT,
+			(vma->vm_flags & VM_WRITE) != 0, 0, NULL, NULL);
+		if(ret > 0){
+			faulted += ret;
+		}
+	}
+
+	up_read(&mm->mmap_sem);
+
+	return faulted;
+}
+
+// make the working set of an admitted process resident before its first job, [start, end) or the whole space
+void prefault_process(int* pid_int_pt, unsigned long start, unsigned long end){
+	struct list_head* pos;
+	mp2_list_entry* this_process;
+	struct task_struct* task;
+	struct mm_struct* mm;
+	unsigned long resident;
+	long faulted;
+
+	task = NULL;
+
+	// only admitted processes, hold the task while the list lock is released
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == *pid_int_pt && pcb_ptr(this_process) != NULL){
+			task = pcb_ptr(this_process);
+			get_task_struct(task);
+			break;
+		}
+	}
+	spin_unlock(&list_lock);
+
+	if(task == NULL){
+		return;
+	}
+
+	// faulting in sleeps, so it is done without the list lock
+	mm = get_task_mm(task);
+	if(mm == NULL){
+		put_task_struct(task);
+		return;
+	}
+	faulted = _prefault_range(task, mm, start, end);
+	resident = get_mm_rss(mm);
+	mmput(mm);
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "prefault [%d] faulted [%ld] resident [%lu]\n", *pid_int_pt, faulted, resident);
+	#endif
+
+	spin_lock(&list_lock);
+	list_for_each(pos, list_head_ptr(regist_head)){
+		this_process = (mp2_list_entry*) pos;
+		if(this_process->pid == *pid_int_pt){
+			this_process->resident_pages = resident;
+			// the prefault itself does not count against the job
+			this_process->min_flt_base = task->min_flt;
+			this_process->maj_flt_base = task->maj_flt;
+			break;
+		}
+	}
+	spin_unlock(&list_lock);
+
+	put_task_struct(task);
+}
+
+
 /*
 
 	Dispatching Thread and Timer
@@ -447,6 +1827,38 @@ int dispatch_thread_func(void *unused){
     	printk(KERN_ALERT "dispatching\n");
     	#endif
 
+    	if(update_groups()){
+    		// the running member used up its group budget, park it until the group is refilled
+    		running_process_pt->state = STATE_READY_CODE;
+
+    		#ifdef DEBUG
+    		printk(KERN_ALERT "throttling [%d]\n", running_process_pt->pid);
+    		#endif
+
+    		#ifndef ECHO_TEST
+    		set_task_state(pcb_ptr(running_process_pt), TASK_UNINTERRUPTIBLE);
+    		sparam.sched_priority = 0;
+			sched_setscheduler(pcb_ptr(running_process_pt), SCHED_NORMAL, &sparam);
+    		#endif
+
+    		running_process_pt = NULL;
+    	}
+
+    	if(update_deadlines()){
+    		// the running job overran its deadline under the abort policy, it sleeps until its next release
+    		#ifdef DEBUG
+    		printk(KERN_ALERT "aborting [%d]\n", running_process_pt->pid);
+    		#endif
+
+    		#ifndef ECHO_TEST
+    		set_task_state(pcb_ptr(running_process_pt), TASK_UNINTERRUPTIBLE);
+    		sparam.sched_priority = 0;
+			sched_setscheduler(pcb_ptr(running_process_pt), SCHED_NORMAL, &sparam);
+    		#endif
+
+    		running_process_pt = NULL;
+    	}
+
     	highest_ready = get_highest_prio_ready_proc();
 
     	if(highest_ready != NULL){
@@ -454,17 +1866,21 @@ int dispatch_thread_func(void *unused){
     			// none current running, set this one to run
     			highest_ready->state = STATE_RUNNING_CODE;
     			running_process_pt = highest_ready;
+    			if(highest_ready->group != NULL){
+    				_group_start(highest_ready);
+    			}
     			
     			#ifdef DEBUG
     			printk(KERN_ALERT "running [%d]\n", highest_ready->pid);
     			#endif
 
     			#ifndef ECHO_TEST
+    			_pin_shared(running_process_pt);
     			wake_up_process(pcb_ptr(running_process_pt));
     			sparam.sched_priority = 99;
 				sched_setscheduler(pcb_ptr(running_process_pt), SCHED_FIFO, &sparam);
     			#endif
-    		}else if(running_process_pt->period > highest_ready->period){
+    		}else if(should_preempt(running_process_pt, highest_ready)){
     			// preempyt current one
     			/*
 					NOTE: the documentation's impl will lead to two processes running concurrently
@@ -472,6 +1888,12 @@ int dispatch_thread_func(void *unused){
     			*/
     			running_process_pt->state = STATE_READY_CODE;
     			highest_ready->state = STATE_RUNNING_CODE;
+    			if(running_process_pt->group != NULL){
+    				_group_stop(running_process_pt);
+    			}
+    			if(highest_ready->group != NULL){
+    				_group_start(highest_ready);
+    			}
     			
     			#ifdef DEBUG
     			printk(KERN_ALERT "switching from [%d] to [%d]\n", running_process_pt->pid, highest_ready->pid);
@@ -483,6 +1905,7 @@ int dispatch_thread_func(void *unused){
     			sparam.sched_priority = 0;
 				sched_setscheduler(pcb_ptr(running_process_pt), SCHED_NORMAL, &sparam);
     			
+    			_pin_shared(highest_ready);
     			wake_up_process(pcb_ptr(highest_ready));
     			sparam.sched_priority = 99;
 				sched_setscheduler(pcb_ptr(highest_ready), SCHED_FIFO, &sparam);
@@ -533,35 +1956,48 @@ void _stop_dispatch_thread(void){
 */
 static ssize_t mp2_proc_read(struct file* file, char __user* buffer, size_t count, loff_t* offset){
 	char *buf;
+	size_t buf_len;
 	ssize_t total;
 
    	#ifdef DEBUG
    	printk(KERN_ALERT "mp2_proc_read called: [%zu]\n", count);
    	#endif
 
-	// if read, return 0 to terminate the reading process
-	if(*offset == READ_DONE){
-		*offset = UNREAD;
-		return 0;
+	// the status can outgrow one read, so the offset is a byte offset into it.
+	// it is rebuilt on every read, a reader in pieces may see entries come & go in between
+	buf_len = _status_buf_len();
+	buf = (char*) kmalloc(buf_len, GFP_KERNEL);
+	if(buf == NULL){
+		return -ENOMEM;
 	}
+	total = read_all_registered(buf, buf_len);
 
-	// not done - read
-	buf = (char*) kmalloc(PROC_READ_BUF_SIZE, GFP_KERNEL);
-	total = read_all_registered(buf, PROC_READ_BUF_SIZE);
+	// past the end - return 0 to terminate the reading process
+	if(*offset >= total){
+		kfree(buf);
+		return 0;
+	}
+	total = min_t(ssize_t, total - *offset, count);
 
-	copy_to_user(buffer, buf ,total);
+	if(copy_to_user(buffer, buf + *offset, total)){
+		total = -EFAULT;
+	}else{
+		*offset += total;
+	}
 
 	kfree(buf);
-	// flag to not to infinite loop
-	*offset = READ_DONE;
 	return total;
 }
 
 static ssize_t mp2_proc_write(struct file* file, const char __user* buffer, size_t count, loff_t* data){
 	char *buf;
 	int* pid_int_pt;
+	int* tgid_int_pt;
+	unsigned long region_start;
+	unsigned long region_len;
 	unsigned int* period_ms_lu_pt;
 	unsigned int* comput_cost_ms_lu_pt;
+	char policy_name[POLICY_NAME_SIZE];
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "mp2_proc_write called\n");
@@ -577,6 +2013,7 @@ static ssize_t mp2_proc_write(struct file* file, const char __user* buffer, size
 	#endif
 
 	pid_int_pt = kmalloc(sizeof(int), GFP_KERNEL);
+	tgid_int_pt = kmalloc(sizeof(int), GFP_KERNEL);
 	period_ms_lu_pt = kmalloc(sizeof(unsigned long), GFP_KERNEL);
 	comput_cost_ms_lu_pt = kmalloc(sizeof(unsigned long), GFP_KERNEL);
 
@@ -598,12 +2035,88 @@ static ssize_t mp2_proc_write(struct file* file, const char __user* buffer, size
 		#endif
 
 		deregister_process(pid_int_pt);
+	}else if(sscanf(buf, PREFAULT_REGION_CMD_FORMAT, pid_int_pt, &region_start, &region_len) == 3){
+		#ifdef DEBUG
+		printk(KERN_ALERT "prefault [%d] region [%lx] length [%lu]\n", *pid_int_pt, region_start, region_len);
+		#endif
+
+		prefault_process(pid_int_pt, region_start, region_start + region_len);
+	}else if(sscanf(buf, PREFAULT_CMD_FORMAT, pid_int_pt) == 1){
+		#ifdef DEBUG
+		printk(KERN_ALERT "prefault [%d]\n", *pid_int_pt);
+		#endif
+
+		prefault_process(pid_int_pt, 0, TASK_SIZE);
+	}else if(sscanf(buf, REGIST_GROUP_CMD_FORMAT, tgid_int_pt, comput_cost_ms_lu_pt, period_ms_lu_pt) == 3){
+		#ifdef DEBUG
+		printk(KERN_ALERT "register group [%d] with period [%u] cost [%u]\n", *tgid_int_pt, *period_ms_lu_pt, *comput_cost_ms_lu_pt);
+		#endif
+
+		register_group(tgid_int_pt, period_ms_lu_pt, comput_cost_ms_lu_pt);
+	}else if(sscanf(buf, JOIN_GROUP_CMD_FORMAT, tgid_int_pt, pid_int_pt) == 2){
+		#ifdef DEBUG
+		printk(KERN_ALERT "join [%d] to group [%d]\n", *pid_int_pt, *tgid_int_pt);
+		#endif
+
+		join_group(tgid_int_pt, pid_int_pt);
+	}else if(sscanf(buf, REGIST_CHILD_CMD_FORMAT, tgid_int_pt, pid_int_pt, comput_cost_ms_lu_pt, period_ms_lu_pt) == 4){
+		#ifdef DEBUG
+		printk(KERN_ALERT "register child [%d] to server [%d] with period [%u] cost [%u]\n", *pid_int_pt, *tgid_int_pt,
+			*period_ms_lu_pt, *comput_cost_ms_lu_pt);
+		#endif
+
+		register_child(tgid_int_pt, pid_int_pt, period_ms_lu_pt, comput_cost_ms_lu_pt);
+	}else if(sscanf(buf, REGIST_PARALLEL_CMD_FORMAT, tgid_int_pt, period_ms_lu_pt, comput_cost_ms_lu_pt) == 3){
+		// the third field is the number of workers
+		#ifdef DEBUG
+		printk(KERN_ALERT "register parallel [%d] with period [%u] workers [%u]\n", *tgid_int_pt, *period_ms_lu_pt, *comput_cost_ms_lu_pt);
+		#endif
+
+		register_parallel(tgid_int_pt, period_ms_lu_pt, comput_cost_ms_lu_pt);
+	}else if(sscanf(buf, JOIN_PARALLEL_CMD_FORMAT, tgid_int_pt, pid_int_pt, comput_cost_ms_lu_pt) == 3){
+		#ifdef DEBUG
+		printk(KERN_ALERT "worker [%d] of parallel [%d] with cost [%u]\n", *pid_int_pt, *tgid_int_pt, *comput_cost_ms_lu_pt);
+		#endif
+
+		join_parallel(tgid_int_pt, pid_int_pt, comput_cost_ms_lu_pt);
+	}else if(sscanf(buf, MODE_CHANGE_CMD_FORMAT, pid_int_pt, comput_cost_ms_lu_pt, period_ms_lu_pt) == 3){
+		#ifdef DEBUG
+		printk(KERN_ALERT "mode change [%d] with period [%u] cost [%u]\n", *pid_int_pt, *period_ms_lu_pt, *comput_cost_ms_lu_pt);
+		#endif
+
+		change_mode(pid_int_pt, period_ms_lu_pt, comput_cost_ms_lu_pt);
+	}else if(sscanf(buf, POLICY_CMD_FORMAT, pid_int_pt, policy_name) == 2){
+		#ifdef DEBUG
+		printk(KERN_ALERT "overload policy [%d] [%s]\n", *pid_int_pt, policy_name);
+		#endif
+
+		set_overload_policy(pid_int_pt, policy_name);
+	}else if(sscanf(buf, OFFSET_CMD_FORMAT, pid_int_pt, tgid_int_pt, period_ms_lu_pt) == 3){
+		// the set id & the offset
+		#ifdef DEBUG
+		printk(KERN_ALERT "offset [%d] set [%d] offset [%u]\n", *pid_int_pt, *tgid_int_pt, *period_ms_lu_pt);
+		#endif
+
+		set_release_offset(pid_int_pt, tgid_int_pt, period_ms_lu_pt);
+	}else if(sscanf(buf, START_CMD_FORMAT, tgid_int_pt) == 1){
+		#ifdef DEBUG
+		printk(KERN_ALERT "start set [%d]\n", *tgid_int_pt);
+		#endif
+
+		start_release_set(tgid_int_pt);
+	}else if(sscanf(buf, DEREGIST_GROUP_CMD_FORMAT, tgid_int_pt) == 1){
+		#ifdef DEBUG
+		printk(KERN_ALERT "deregister group [%d]\n", *tgid_int_pt);
+		#endif
+
+		deregister_group(tgid_int_pt);
 	}
 	// do nothing if error formatted input
 
    	// free the temp buf and return success signal
    	kfree(buf);
    	kfree(pid_int_pt);
+   	kfree(tgid_int_pt);
    	kfree(period_ms_lu_pt);
    	kfree(comput_cost_ms_lu_pt);
    	return count;
@@ -615,14 +2128,110 @@ static const struct file_operations mp2_proc_file_callbacks = {
    .write = mp2_proc_write
 };
 
+/*
+	The query file answers admission what-if questions without touching any state:
+	every open file keeps its own last query, so concurrent callers do not mix answers.
+*/
+static int mp2_query_open(struct inode* inode, struct file* file){
+	mp2_query* query;
+
+	query = kmalloc(sizeof(mp2_query), GFP_KERNEL);
+	if(query == NULL){
+		return -ENOMEM;
+	}
+	query->valid = 0;
+	file->private_data = query;
+
+	return 0;
+}
+
+static int mp2_query_release(struct inode* inode, struct file* file){
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t mp2_query_write(struct file* file, const char __user* buffer, size_t count, loff_t* data){
+	char buf[QUERY_REPLY_SIZE];
+	mp2_query* query;
+	size_t len;
+
+	query = file->private_data;
+
+	len = min(count, (size_t) QUERY_REPLY_SIZE - 1);
+	if(copy_from_user(buf, buffer, len)){
+		return -EFAULT;
+	}
+	buf[len] = '\0';
+
+	// a malformed query is remembered as invalid, the reply then admits nothing
+	query->valid = sscanf(buf, QUERY_CMD_FORMAT, &query->cost, &query->period) == 2
+		&& query->period != 0 && query->cost <= query->period;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "query cost [%u] period [%u] valid [%d]\n", query->cost, query->period, query->valid);
+	#endif
+
+	return count;
+}
+
+static ssize_t mp2_query_read(struct file* file, char __user* buffer, size_t count, loff_t* offset){
+	char buf[QUERY_REPLY_SIZE];
+	mp2_query* query;
+	unsigned int load;
+	int admit;
+	unsigned int max_cost;
+	int len;
+
+	// same one shot protocol as the status file
+	if(*offset == READ_DONE){
+		*offset = UNREAD;
+		return 0;
+	}
+
+	query = file->private_data;
+
+	// one snapshot of current_load for the whole answer
+	spin_lock(&list_lock);
+	load = current_load;
+	spin_unlock(&list_lock);
+
+	admit = 0;
+	max_cost = 0;
+	if(query->valid){
+		admit = admit_load(load, compute_load(query->cost, query->period));
+		max_cost = max_admissible_cost(load, query->period);
+	}
+
+	len = snprintf(buf, QUERY_REPLY_SIZE, QUERY_REPLY_FORMAT, admit, remaining_load(load), max_cost);
+	if((size_t) len > count){
+		return -EINVAL;
+	}
+	if(copy_to_user(buffer, buf, len)){
+		return -EFAULT;
+	}
+
+	*offset = READ_DONE;
+	return len;
+}
+
+static const struct file_operations mp2_query_file_callbacks = {
+   .owner = THIS_MODULE,
+   .open = mp2_query_open,
+   .read = mp2_query_read,
+   .write = mp2_query_write,
+   .release = mp2_query_release
+};
+
 // make proc file
 void _create_proc_mp2_status(void){
 	mp2_proc_dir = proc_mkdir(PROC_DIR_NAME, NULL);
 	mp2_proc_entry = proc_create(PROC_FILE_NAME, 0666, mp2_proc_dir, &mp2_proc_file_callbacks);
+	mp2_query_entry = proc_create(PROC_QUERY_FILE_NAME, 0666, mp2_proc_dir, &mp2_query_file_callbacks);
 }
 
 // remove the proc file
 void _delete_proc_mp2_status(void){
+   	remove_proc_entry(PROC_QUERY_FILE_NAME, mp2_proc_dir);
    	remove_proc_entry(PROC_FILE_NAME, mp2_proc_dir);
    	remove_proc_entry(PROC_DIR_NAME, NULL);
 }
@@ -0,0 +1,273 @@
+#include "mp2_core.h"
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+// indexed by the OVERLOAD_* codes
+static const char* overload_policy_names[OVERLOAD_POLICIES] = { "skip", "late", "abort", "signal" };
+
+/*
+
+	Admission Control
+
+*/
+// the load of a process: 1000 * c / p, +1 to make the condition a little stricter
+unsigned int compute_load(unsigned int cost, unsigned int period){
+	return (1000 * cost / period) + 1;
+}
+
+// return non-zero if this_load fits on top of current_load
+int admit_load(unsigned int current_load, unsigned int this_load){
+	return this_load + current_load <= LOAD_BOUND;
+}
+
+// the load still admissible on top of current_load
+unsigned int remaining_load(unsigned int current_load){
+	if(current_load >= LOAD_BOUND){
+		return 0;
+	}
+	return LOAD_BOUND - current_load;
+}
+
+// the largest cost with compute_load(cost, period) <= remaining_load, i.e. 1000 * cost < remaining * period
+unsigned int max_admissible_cost(unsigned int current_load, unsigned int period){
+	unsigned long remaining;
+
+	remaining = remaining_load(current_load);
+	if(remaining == 0 || period == 0){
+		return 0;
+	}
+	return (remaining * period - 1) / 1000;
+}
+
+/*
+	Compositional analysis of a server (budget cost every period) as a periodic resource:
+	in any interval t it supplies at least (cost/period) * (t - 2 * (period - cost)).
+	RMS children are schedulable inside it if their load fits the usual bound, scaled down
+	by the server bandwidth and by the worst case blackout 2 * (period - cost) relative to
+	the shortest child period. Conservative, but it only looks at the server's own children,
+	so a tenant can add or remove tasks without any global re-admission.
+*/
+unsigned int server_capacity(mp2_group* server, unsigned long min_period){
+	unsigned long blackout;
+	unsigned long bandwidth;
+
+	blackout = 2 * (server->period - server->cost);
+	if(min_period <= blackout){
+		return 0;
+	}
+
+	bandwidth = 1000 * server->cost / server->period;
+	return bandwidth * (min_period - blackout) / min_period * LOAD_BOUND / 1000;
+}
+
+// return non-zero if a child with this period & load fits in the server next to the current children
+int admit_child(mp2_group* server, unsigned long period, unsigned int this_load){
+	unsigned long min_period;
+
+	min_period = period;
+	if(server->min_child_period != 0 && server->min_child_period < min_period){
+		min_period = server->min_child_period;
+	}
+
+	return server->child_load + this_load <= server_capacity(server, min_period);
+}
+
+/*
+	Federated scheduling of a fork-join task with total work C, span L (its longest worker)
+	and deadline D (= period). A light task (C <= D) runs sequentially in the shared RMS domain
+	like any other reservation. A heavy task gets n = ceil((C - L) / (D - L)) cores of its own,
+	on which a greedy schedule finishes every job within L + (C - L) / n <= D.
+*/
+unsigned int federated_cores(unsigned long work, unsigned long span, unsigned long period){
+	if(work <= period){
+		return 0;
+	}
+	if(span >= period){
+		return FEDERATED_INFEASIBLE;
+	}
+
+	return (work - span + (period - span) - 1) / (period - span);
+}
+
+
+/*
+
+	Mode Changes
+
+*/
+// the load a task holds: during a mode change, the larger of the old and the new one,
+// since the old parameters stay in effect until the next period boundary
+unsigned int reserved_load(mp2_list_entry* entry){
+	if(entry->mode_pending && entry->mode_load > entry->load){
+		return entry->mode_load;
+	}
+	return entry->load;
+}
+
+// the load to admit for a mode change to new_load, on top of everything but this task
+unsigned int transition_load(mp2_list_entry* entry, unsigned int new_load){
+	if(new_load > entry->load){
+		return new_load;
+	}
+	return entry->load;
+}
+
+// the period boundary came: switch to the new parameters
+void apply_mode_change(mp2_list_entry* entry){
+	entry->period = entry->mode_period;
+	entry->cost = entry->mode_cost;
+	entry->load = entry->mode_load;
+	entry->mode_pending = 0;
+}
+
+
+/*
+
+	Periods
+
+*/
+unsigned long compute_next_period(unsigned long next_period, unsigned long period, unsigned long now){
+	if(next_period == 0){
+		// newly registered, immediately ready
+		return now;
+	}
+
+	// finished job, if no missing jobs, this loop will only run once
+	while(next_period <= now){
+		next_period += period;
+	}
+	return next_period;
+}
+
+// a job completing after its deadline (the next period boundary) is late: the late policy releases
+// the next job right away and the periods count from there, every other policy skips the missed periods
+unsigned long overload_next_period(mp2_list_entry* entry, unsigned long now){
+	if(entry->policy == OVERLOAD_LATE && entry->next_period != 0 && entry->next_period + entry->period <= now){
+		return now;
+	}
+	return compute_next_period(entry->next_period, entry->period, now);
+}
+
+// epoch + offset, or if the task yields later than that, the first boundary of the same phase not yet passed
+unsigned long first_release(unsigned long epoch, unsigned long offset, unsigned long period, unsigned long now){
+	unsigned long release;
+
+	release = epoch + offset;
+	while(release < now){
+		release += period;
+	}
+	return release;
+}
+
+int overload_policy_code(const char* name){
+	int policy;
+
+	for(policy = 0; policy < OVERLOAD_POLICIES; policy++){
+		if(strcmp(name, overload_policy_names[policy]) == 0){
+			return policy;
+		}
+	}
+	return -1;
+}
+
+const char* overload_policy_str(int policy){
+	if(policy < 0 || policy >= OVERLOAD_POLICIES){
+		return "unknown";
+	}
+	return overload_policy_names[policy];
+}
+
+
+/*
+
+	Ready Queue & Preemption
+
+*/
+// two level priority: first the period of the top level reservation, then the own period
+unsigned long top_period(mp2_list_entry* entry){
+	if(entry->group != NULL){
+		return entry->group->period;
+	}
+	return entry->period;
+}
+
+// ready, and for group members, the group still has budget left.
+// Workers of a heavy parallel task run on their own cores, never in the shared domain
+int is_dispatchable(mp2_list_entry* entry){
+	return entry->state == STATE_READY_CODE
+		&& (entry->group == NULL || (entry->group->cores == 0 && entry->group->budget > 0));
+}
+
+// return non-zero if a has a strictly higher priority than b
+static int higher_prio(mp2_list_entry* a, mp2_list_entry* b){
+	if(top_period(a) != top_period(b)){
+		return top_period(a) < top_period(b);
+	}
+	return a->period < b->period;
+}
+
+// the dispatchable process with the shortest period, NULL if none. Inside a group or a server,
+// the shortest own period wins, so this is the two level selection in one pass
+mp2_list_entry* pick_highest_prio_ready(mp2_list_entry* regist_head){
+	mp2_list_entry* this_process;
+	mp2_list_entry* ret_pt;
+	struct list_head* pos;
+
+	ret_pt = NULL;
+	// list traversal, it is a for loop
+	list_for_each(pos, list_head_ptr(regist_head) ){
+		this_process = (mp2_list_entry*) pos;
+
+		if(is_dispatchable(this_process)){
+			if(ret_pt == NULL || higher_prio(this_process, ret_pt)){
+				ret_pt = this_process;
+			}
+		}
+	}
+
+	return ret_pt;
+}
+
+// no context switch if there is a tie between the two periods
+int should_preempt(mp2_list_entry* running, mp2_list_entry* candidate){
+	return higher_prio(candidate, running);
+}
+
+
+/*
+
+	Group Budgets
+
+*/
+// charge the time the running member used since the last charge
+void group_charge(mp2_group* group, unsigned long now){
+	unsigned long used;
+
+	used = now - group->run_start;
+
+	group->used_total += used;
+	if(used > group->budget){
+		group->budget = 0;
+	}else{
+		group->budget -= used;
+	}
+	group->run_start = now;
+}
+
+// a new group period: full budget again
+void group_refill(mp2_group* group){
+	group->budget = group->cost;
+	group->job_count += 1;
+}
+
+// one worker of a parallel job joined, return non-zero if it was the last one
+int parallel_worker_done(mp2_group* task){
+	if(task->pending > 0){
+		task->pending -= 1;
+	}
+	return task->pending == 0;
+}
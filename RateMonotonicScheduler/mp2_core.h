@@ -0,0 +1,225 @@
+#ifndef __MP2_CORE_INCLUDE__
+#define __MP2_CORE_INCLUDE__
+
+/*
+
+	The scheduling policy & admission control of MP2, without any kernel glue.
+	It is compiled into the module (mp2.o) and into the userspace simulator (mp2sim),
+	so that the time unit is just "ticks": jiffies in the module, the virtual clock in mp2sim.
+
+*/
+
+#ifdef __KERNEL__
+#include <linux/list.h>
+#include <linux/timer.h>
+#include <linux/cpumask.h>
+#else
+#include <stddef.h>
+
+// userspace build: the few linux/list.h helpers the core and the simulator need
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head* list){
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add(struct list_head* new, struct list_head* head){
+	head->next->prev = new;
+	new->next = head->next;
+	new->prev = head;
+	head->next = new;
+}
+
+static inline void list_add_tail(struct list_head* new, struct list_head* head){
+	head->prev->next = new;
+	new->prev = head->prev;
+	new->next = head;
+	head->prev = new;
+}
+
+static inline void list_del(struct list_head* entry){
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+	entry->next = NULL;
+	entry->prev = NULL;
+}
+
+#define list_for_each(pos, head) \
+	for(pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_safe(pos, n, head) \
+	for(pos = (head)->next, n = pos->next; pos != (head); pos = n, n = pos->next)
+#endif
+
+// the state of the process
+#define STATE_RUNNING_CODE 	0
+#define STATE_RUNNING_STR	"running"
+#define STATE_READY_CODE 	1
+#define STATE_READY_STR		"ready"
+#define STATE_SLEEPING_CODE	2
+#define STATE_SLEEPING_STR 	"sleeping"
+
+// what happens when a job is still running at its deadline
+#define OVERLOAD_SKIP		0	// finish it, then skip the periods it overran
+#define OVERLOAD_LATE		1	// finish it, then release the next job right away and shift the phase
+#define OVERLOAD_ABORT		2	// take the cpu away until the next period boundary
+#define OVERLOAD_SIGNAL		3	// send SIGXCPU and let the task decide, then as skip
+#define OVERLOAD_POLICIES	4
+
+// admission control: to immitate \sigma{c/p} < 0.693 ==> 1000*c/p < 693
+#define LOAD_BOUND 693
+
+// federated test result for a parallel task that can not meet its deadline on any number of cores
+#define FEDERATED_INFEASIBLE ((unsigned int) -1)
+
+// group reservation: one (cost, period) budget shared by several threads of a process,
+// a tenant server whose child tasks are scheduled inside the budget,
+// or a fork-join parallel task whose workers are released together every period
+typedef struct mp2_group_t {
+	struct list_head head;
+
+	int tgid; // the process for thread groups, any id for tenant servers
+	unsigned int member_count;
+
+	// children admitted against this budget: their total load & their shortest period (ticks)
+	unsigned int child_load;
+	unsigned long min_child_period;
+
+	// keep these in ticks
+	unsigned long period;
+	unsigned long next_period;
+	unsigned long cost;
+
+	// compute once
+	unsigned int load;
+
+	// budget left in the current period & when the running member got dispatched, in ticks
+	unsigned long budget;
+	unsigned long run_start;
+	// set by the period timer, consumed by the dispatch thread
+	int release_pending;
+
+	// parallel tasks: declared workers (0 for plain groups & servers), the longest worker cost,
+	// the cores dedicated to the task (0: it runs in the shared RMS domain) & the workers not joined yet
+	unsigned int workers;
+	unsigned long span;
+	unsigned int cores;
+	unsigned int pending;
+	// parallel tasks are admitted once the last worker is declared, plain groups right away
+	int admitted;
+	unsigned long job_release;
+
+	// group level stats
+	unsigned long job_count;
+	unsigned long throttle_count;
+	unsigned long used_total;
+	unsigned long miss_count;
+
+	#ifdef __KERNEL__
+	// replenish the budget every period & cut the running member off when the budget runs out
+	struct timer_list period_timer;
+	struct timer_list budget_timer;
+	// the dedicated cores of a heavy parallel task
+	struct cpumask cpus;
+	#endif
+} mp2_group;
+
+// register, deregister: linked list entry
+typedef struct mp2_list_entry_t {
+	struct list_head head;
+
+	#ifdef __KERNEL__
+	// referenced for as long as the entry lives, NULL if the pid had no task
+	struct task_struct* pcb_pt;
+	// fault counters of the task when it got admitted & its resident pages after the last prefault
+	unsigned long min_flt_base;
+	unsigned long maj_flt_base;
+	unsigned long resident_pages;
+	// the affinity & policy of the task before the module first moved it, NULL while it is untouched
+	struct mp2_saved_sched_t* saved;
+	#endif
+
+	int state; // run 0, ready 1, sleep 2
+	int pid;
+
+	// the reservation this thread belongs to, NULL if it has its own
+	mp2_group* group;
+	// released by its own timer: standalone processes & server children, not group threads
+	int own_release;
+
+	// keep these in ticks
+	unsigned long period;
+	unsigned long next_period;
+	unsigned long cost;
+
+	// compute once
+	unsigned int load;
+
+	// overload policy, deadline misses counted under each policy & a miss not handled yet
+	int policy;
+	unsigned long miss_count[OVERLOAD_POLICIES];
+	int miss_pending;
+
+	// start set (0 for none): the first release is at the set's epoch + offset, the epoch is 0 until the
+	// start command & start_waiting tells that the task already yielded and waits for it
+	int start_set;
+	unsigned long offset;
+	unsigned long epoch;
+	int start_waiting;
+
+	// a mode change admitted but not applied yet: the parameters from the next period boundary on
+	int mode_pending;
+	unsigned long mode_period;
+	unsigned long mode_cost;
+	unsigned int mode_load;
+
+	#ifdef __KERNEL__
+	// the timer used by yield for the release, then re-armed for the deadline of the released job
+	struct timer_list wakeup_timer;
+	#endif
+} mp2_list_entry;
+// struct access macros
+#define list_head_ptr(entry) ( &(entry->head) )
+
+// admission control
+unsigned int compute_load(unsigned int cost, unsigned int period);
+int admit_load(unsigned int current_load, unsigned int this_load);
+unsigned int server_capacity(mp2_group* server, unsigned long min_period);
+int admit_child(mp2_group* server, unsigned long period, unsigned int this_load);
+unsigned int federated_cores(unsigned long work, unsigned long span, unsigned long period);
+
+// what-if queries: the load left under the bound & the largest cost (same unit as period) that still fits
+unsigned int remaining_load(unsigned int current_load);
+unsigned int max_admissible_cost(unsigned int current_load, unsigned int period);
+
+// mode changes: admitted right away, applied at the next period boundary
+unsigned int reserved_load(mp2_list_entry* entry);
+unsigned int transition_load(mp2_list_entry* entry, unsigned int new_load);
+void apply_mode_change(mp2_list_entry* entry);
+
+// the release after a yield: now for the first yield, otherwise the next period boundary not yet passed
+unsigned long compute_next_period(unsigned long next_period, unsigned long period, unsigned long now);
+// the same, according to the overload policy of the task
+unsigned long overload_next_period(mp2_list_entry* entry, unsigned long now);
+// the first release of a task with a release offset from a shared epoch
+unsigned long first_release(unsigned long epoch, unsigned long offset, unsigned long period, unsigned long now);
+
+// overload policy names, -1 for an unknown one
+int overload_policy_code(const char* name);
+const char* overload_policy_str(int policy);
+
+// ready queue selection & preemption rules
+unsigned long top_period(mp2_list_entry* entry);
+int is_dispatchable(mp2_list_entry* entry);
+mp2_list_entry* pick_highest_prio_ready(mp2_list_entry* regist_head);
+int should_preempt(mp2_list_entry* running, mp2_list_entry* candidate);
+
+// group budget rules
+void group_charge(mp2_group* group, unsigned long now);
+void group_refill(mp2_group* group);
+int parallel_worker_done(mp2_group* task);
+
+#endif
@@ -0,0 +1,423 @@
+#include "mp2_core.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+
+	mp2sim: replay a task set against the MP2 scheduling core with a virtual clock
+
+	usage: ./mp2sim [-n] [-v] [-o skip|late] [task set file] [horizon in ms]
+		-n: no admission control, every task is accepted
+		-v: print one line per task at the end
+		-o: the overload policy of every task, default skip
+
+	task set file: one "cost period [offset]" line per task, in ms, '#' starts a comment,
+		the offset delays the first release from the common start
+	time unit: one virtual tick is one ms, i.e. jiffies with HZ=1000
+
+	Each admitted task behaves like userapp: it yields right after registering,
+	then runs exactly cost ticks per job and yields again. The dispatching is done
+	by the same core functions as the module.
+
+*/
+
+#define DEFAULT_HORIZON 10000
+#define LINE_SIZE 256
+#define NANOSEC 1000000000L
+
+// tick 0 means "never yielded" to the core
+#define SIM_START 1
+#define SIM_NEVER ((unsigned long) -1)
+
+typedef struct sim_task_t {
+	// first member: the core walks the list by casting
+	mp2_list_entry entry;
+
+	int admitted;
+
+	// the current job
+	unsigned long release;
+	unsigned long remaining;
+
+	// per task stats
+	unsigned long jobs;
+	unsigned long completed;
+	unsigned long misses;
+	unsigned long skipped;
+	unsigned long preempted;
+	unsigned long max_response;
+} sim_task;
+
+// the task set & the core's linked list
+static sim_task* tasks = NULL;
+static int task_count = 0;
+static mp2_list_entry regist_head;
+static unsigned int current_load = 0;
+static int overload_policy = OVERLOAD_SKIP;
+
+// release timers: a binary min-heap on next_period
+static sim_task** heap = NULL;
+static int heap_size = 0;
+
+// global stats
+static unsigned long event_count = 0;
+static unsigned long preemption_count = 0;
+static long decision_ns_total = 0;
+static long decision_ns_max = 0;
+
+
+/*
+
+	Release Timers
+
+*/
+void heap_push(sim_task* task){
+	int pos;
+	int parent;
+
+	pos = heap_size;
+	heap_size += 1;
+
+	while(pos > 0){
+		parent = (pos - 1) / 2;
+		if(heap[parent]->entry.next_period <= task->entry.next_period){
+			break;
+		}
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
+	heap[pos] = task;
+}
+
+sim_task* heap_pop(void){
+	sim_task* top;
+	sim_task* last;
+	int pos;
+	int child;
+
+	top = heap[0];
+	heap_size -= 1;
+	last = heap[heap_size];
+
+	pos = 0;
+	while(2 * pos + 1 < heap_size){
+		child = 2 * pos + 1;
+		if(child + 1 < heap_size && heap[child + 1]->entry.next_period < heap[child]->entry.next_period){
+			child += 1;
+		}
+		if(last->entry.next_period <= heap[child]->entry.next_period){
+			break;
+		}
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = last;
+
+	return top;
+}
+
+unsigned long heap_top_time(void){
+	if(heap_size == 0){
+		return SIM_NEVER;
+	}
+	return heap[0]->entry.next_period;
+}
+
+
+/*
+
+	Task Set
+
+*/
+// read "cost period" lines, return the number of tasks read, -1 on error
+int load_task_set(char* path){
+	FILE* file;
+	char line[LINE_SIZE];
+	unsigned int cost;
+	unsigned int period;
+	unsigned int offset;
+	int capacity;
+
+	file = fopen(path, "r");
+	if(file == NULL){
+		printf("cannot open task set [%s]\n", path);
+		return -1;
+	}
+
+	capacity = 64;
+	tasks = malloc(capacity * sizeof(sim_task));
+	task_count = 0;
+
+	while(fgets(line, LINE_SIZE, file) != NULL){
+		offset = 0;
+		if(line[0] == '#' || sscanf(line, "%u %u %u", &cost, &period, &offset) < 2){
+			continue;
+		}
+		if(period == 0 || cost == 0 || cost > period){
+			printf("skip malformed task [%u %u]\n", cost, period);
+			continue;
+		}
+
+		if(task_count == capacity){
+			capacity *= 2;
+			tasks = realloc(tasks, capacity * sizeof(sim_task));
+		}
+
+		memset(&tasks[task_count], 0, sizeof(sim_task));
+		tasks[task_count].entry.pid = task_count + 1;
+		tasks[task_count].entry.state = STATE_SLEEPING_CODE;
+		tasks[task_count].entry.group = NULL;
+		tasks[task_count].entry.own_release = 1;
+		tasks[task_count].entry.mode_pending = 0;
+		tasks[task_count].entry.policy = overload_policy;
+		tasks[task_count].entry.offset = offset;
+		tasks[task_count].entry.cost = cost;
+		tasks[task_count].entry.period = period;
+		tasks[task_count].entry.next_period = 0;
+		tasks[task_count].entry.load = compute_load(cost, period);
+		task_count += 1;
+	}
+
+	fclose(file);
+	return task_count;
+}
+
+// register every task like the module does, the first yield comes right after
+void register_all(int admission){
+	int i;
+
+	INIT_LIST_HEAD(list_head_ptr((&regist_head)));
+	heap = malloc(task_count * sizeof(sim_task*));
+	heap_size = 0;
+
+	for(i = 0; i < task_count; i++){
+		if(admission && !admit_load(current_load, tasks[i].entry.load)){
+			continue;
+		}
+
+		tasks[i].admitted = 1;
+		current_load += tasks[i].entry.load;
+		list_add(list_head_ptr((&tasks[i].entry)), list_head_ptr((&regist_head)));
+
+		// initial yield, all tasks are in one start set started at SIM_START
+		tasks[i].entry.next_period = first_release(SIM_START, tasks[i].entry.offset, tasks[i].entry.period, SIM_START);
+		heap_push(&tasks[i]);
+	}
+}
+
+
+/*
+
+	Simulation
+
+*/
+long elapsed_ns(struct timespec* start, struct timespec* end){
+	return (end->tv_sec - start->tv_sec) * NANOSEC + (end->tv_nsec - start->tv_nsec);
+}
+
+// the job of the running task is done: yield it
+void complete_job(sim_task* task, unsigned long now){
+	unsigned long response;
+	unsigned long last_release;
+
+	response = now - task->release;
+	task->completed += 1;
+	if(response > task->max_response){
+		task->max_response = response;
+	}
+	if(response > task->entry.period){
+		task->misses += 1;
+	}
+
+	task->entry.state = STATE_SLEEPING_CODE;
+	last_release = task->entry.next_period;
+	task->entry.next_period = overload_next_period(&task->entry, now);
+	task->skipped += (task->entry.next_period - last_release) / task->entry.period - 1;
+
+	heap_push(task);
+}
+
+// the dispatch thread body, return the new running task
+sim_task* dispatch(sim_task* running){
+	struct timespec start;
+	struct timespec end;
+	mp2_list_entry* highest_ready;
+	long cost_ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	highest_ready = pick_highest_prio_ready(&regist_head);
+	if(highest_ready != NULL){
+		if(running == NULL){
+			highest_ready->state = STATE_RUNNING_CODE;
+			running = (sim_task*) highest_ready;
+		}else if(should_preempt(&running->entry, highest_ready)){
+			running->entry.state = STATE_READY_CODE;
+			running->preempted += 1;
+			preemption_count += 1;
+			highest_ready->state = STATE_RUNNING_CODE;
+			running = (sim_task*) highest_ready;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	cost_ns = elapsed_ns(&start, &end);
+	decision_ns_total += cost_ns;
+	if(cost_ns > decision_ns_max){
+		decision_ns_max = cost_ns;
+	}
+
+	return running;
+}
+
+// run until the virtual clock passes horizon
+void simulate(unsigned long horizon){
+	sim_task* running;
+	sim_task* released;
+	unsigned long now;
+	unsigned long next_event;
+
+	running = NULL;
+	now = SIM_START;
+
+	while(1){
+		// the next event: a release or the running job completing
+		next_event = heap_top_time();
+		if(running != NULL && now + running->remaining < next_event){
+			next_event = now + running->remaining;
+		}
+		if(next_event == SIM_NEVER || next_event > horizon){
+			break;
+		}
+
+		if(running != NULL){
+			running->remaining -= next_event - now;
+		}
+		now = next_event;
+
+		if(running != NULL && running->remaining == 0){
+			complete_job(running, now);
+			running = NULL;
+		}
+
+		// fire the timers due
+		while(heap_top_time() <= now){
+			released = heap_pop();
+			released->entry.state = STATE_READY_CODE;
+			released->release = released->entry.next_period;
+			released->remaining = released->entry.cost;
+			released->jobs += 1;
+		}
+
+		running = dispatch(running);
+		event_count += 1;
+	}
+}
+
+
+/*
+
+	Report
+
+*/
+void report(unsigned long end, int verbose){
+	int i;
+	int admitted;
+	unsigned long jobs;
+	unsigned long completed;
+	unsigned long misses;
+	unsigned long skipped;
+
+	admitted = 0;
+	jobs = 0;
+	completed = 0;
+	misses = 0;
+	skipped = 0;
+
+	for(i = 0; i < task_count; i++){
+		if(!tasks[i].admitted){
+			continue;
+		}
+
+		// a job still pending at the end counts as missed once its deadline has passed
+		if(tasks[i].jobs > tasks[i].completed && tasks[i].release + tasks[i].entry.period < end){
+			tasks[i].misses += 1;
+		}
+
+		admitted += 1;
+		jobs += tasks[i].jobs;
+		completed += tasks[i].completed;
+		misses += tasks[i].misses;
+		skipped += tasks[i].skipped;
+	}
+
+	printf("tasks [%d] admitted [%d] rejected [%d] load [%u/%u]\n", task_count, admitted,
+		task_count - admitted, current_load, LOAD_BOUND);
+	printf("horizon [%lu ms] jobs released [%lu] completed [%lu]\n", end - SIM_START, jobs, completed);
+	printf("deadline misses [%lu] skipped periods [%lu] preemptions [%lu]\n", misses, skipped, preemption_count);
+	printf("events [%lu] decision cost avg [%ld ns] max [%ld ns]\n", event_count,
+		event_count == 0 ? 0 : decision_ns_total / (long) event_count, decision_ns_max);
+
+	if(verbose){
+		printf("pid,cost,period,admitted,jobs,completed,misses,skipped,preempted,max_response\n");
+		for(i = 0; i < task_count; i++){
+			printf("%d,%lu,%lu,%d,%lu,%lu,%lu,%lu,%lu,%lu\n", tasks[i].entry.pid, tasks[i].entry.cost,
+				tasks[i].entry.period, tasks[i].admitted, tasks[i].jobs, tasks[i].completed,
+				tasks[i].misses, tasks[i].skipped, tasks[i].preempted, tasks[i].max_response);
+		}
+	}
+}
+
+int main(int argc, char* argv[]){
+	int opt;
+	int admission;
+	int verbose;
+	unsigned long horizon;
+
+	admission = 1;
+	verbose = 0;
+	while((opt = getopt(argc, argv, "nvo:")) != -1){
+		if(opt == 'n'){
+			admission = 0;
+		}else if(opt == 'v'){
+			verbose = 1;
+		}else if(opt == 'o'){
+			// abort & signal act at the deadline, in the module only
+			overload_policy = overload_policy_code(optarg);
+			if(overload_policy != OVERLOAD_SKIP && overload_policy != OVERLOAD_LATE){
+				printf("mp2sim only simulates the skip and late overload policies\n");
+				return 1;
+			}
+		}else{
+			printf("usage: ./mp2sim [-n] [-v] [-o skip|late] [task set file] [horizon in ms]\n");
+			return 1;
+		}
+	}
+
+	if(optind >= argc){
+		printf("usage: ./mp2sim [-n] [-v] [-o skip|late] [task set file] [horizon in ms]\n");
+		return 1;
+	}
+
+	horizon = DEFAULT_HORIZON;
+	if(optind + 1 < argc){
+		sscanf(argv[optind + 1], "%lu", &horizon);
+	}
+
+	if(load_task_set(argv[optind]) < 0){
+		return 1;
+	}
+
+	register_all(admission);
+	simulate(SIM_START + horizon);
+	report(SIM_START + horizon, verbose);
+
+	free(heap);
+	free(tasks);
+	return 0;
+}
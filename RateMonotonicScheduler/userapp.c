@@ -8,6 +8,10 @@
 #include <stdbool.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <signal.h>
 
 /*
 
@@ -21,17 +25,55 @@
 #define REGIST_CMD_FORMAT "R,%d,%u,%u"
 #define YIELD_CMD_FORMAT "Y,%d"
 #define DEREGIST_CMD_FORMAT "D,%d"
+#define REGIST_GROUP_CMD_FORMAT "G,%d,%u,%u"
+#define JOIN_GROUP_CMD_FORMAT "J,%d,%d"
+#define DEREGIST_GROUP_CMD_FORMAT "GD,%d"
+#define REGIST_CHILD_CMD_FORMAT "C,%d,%d,%u,%u"
+#define REGIST_PARALLEL_CMD_FORMAT "P,%d,%u,%u"
+#define JOIN_PARALLEL_CMD_FORMAT "W,%d,%d,%u"
+#define MODE_CHANGE_CMD_FORMAT "M,%d,%u,%u"
+#define POLICY_CMD_FORMAT "O,%d,%s"
+#define OFFSET_CMD_FORMAT "E,%d,%d,%u"
+#define START_CMD_FORMAT "T,%d"
+#define PREFAULT_CMD_FORMAT "L,%d"
+#define PREFAULT_REGION_CMD_FORMAT "L,%d,%lx,%lu"
+#define QUERY_CMD_FORMAT "%u,%u"
+#define QUERY_REPLY_FORMAT "%d,%u,%u"
 
 #define READ_SIZE 2048
 #define WRITE_SIZE 256
 
 #define ITERATION 6
 
-// input * cost_base = actual cost in milliseconds
-#define COST_BASE 31
-#define JOB_BASE 10000000
-
 #define MICROSEC 1000000
+#define NANOSEC 1000000000LL
+
+// workload engine: one unit of work of each kind, calibrated against thread cpu time at startup
+#define CPU_UNIT_STEPS 4096
+#define MEM_UNIT_STEPS 256
+#define MEM_BUF_SIZE (32 * 1024 * 1024)
+#define CACHE_LINE_WORDS (64 / sizeof(size_t))
+#define CALIBRATION_US 200000
+#define CALIBRATION_CHECK 64
+
+// job profiles
+#define PROFILE_CPU "cpu"
+#define PROFILE_MEM "mem"
+#define PROFILE_MIXED "mixed"
+
+// the optional trailing arguments: lock & prefault the address space when admitted,
+// and the overload policy for jobs still running at their deadline
+#define LOCK_OPTION "lock"
+#define POLICY_OPTIONS "skip|late|abort|signal"
+#define POLICY_COUNT 4
+// offset=set:ms puts the task in a start set, ./userapp start set starts it
+#define OFFSET_OPTION_FORMAT "offset=%d:%u"
+#define OFFSET_OPTION "offset=set:ms"
+#define START_COMMAND "start"
+
+// the last line userapp prints, parsed by the experiment harness:
+// pid, accepted, cost (ms), period (ms), jobs, deadline misses, avg & max response time (us)
+#define RESULT_FORMAT "result,%d,%d,%d,%d,%d,%d,%lld,%lld\n"
 
 /*
 
@@ -74,19 +116,73 @@ char* to_next_newline(char* input){
 	return input + 1;
 }
 
+// ask the module whether (cost, period) would be admitted, without registering anything.
+// remaining gets the load left under the bound (x1000), max_cost the largest cost admissible at this period
+bool query_admission(unsigned cost, unsigned period, unsigned* remaining, unsigned* max_cost){
+	char buf[WRITE_SIZE];
+	int query_fd;
+	int admit;
+	ssize_t len;
+
+	admit = 0;
+	*remaining = 0;
+	*max_cost = 0;
+
+	query_fd = open("/proc/mp2/query", O_RDWR);
+	if(query_fd == -1){
+		return false;
+	}
+
+	sprintf(buf, QUERY_CMD_FORMAT, cost, period);
+	write(query_fd, buf, strlen(buf));
+	len = read(query_fd, buf, WRITE_SIZE - 1);
+	if(len > 0){
+		buf[len] = '\0';
+		sscanf(buf, QUERY_REPLY_FORMAT, &admit, remaining, max_cost);
+	}
+
+	close(query_fd);
+	return admit != 0;
+}
+
 // check whether the id is accepted
 bool check_accepted(int pid){
 	char* buf;
+	char* grown;
 	char* this_entry_pt;
 	int* temp;
 	bool ret;
+	size_t len;
+	size_t size;
+	ssize_t got;
 
 	ret = false;
 
 	if(fd != -1){
-		buf = (char*) calloc(READ_SIZE, sizeof(char));
+		// the status grows with the registered tasks, read it to the end
+		size = READ_SIZE;
+		len = 0;
+		buf = (char*) malloc(size);
+		while(buf != NULL){
+			got = pread(fd, buf + len, size - len - 1, len);
+			if(got <= 0){
+				break;
+			}
+			len += got;
+			if(len == size - 1){
+				size *= 2;
+				grown = (char*) realloc(buf, size);
+				if(grown == NULL){
+					break;
+				}
+				buf = grown;
+			}
+		}
+		if(buf == NULL){
+			return false;
+		}
+		buf[len] = '\0';
 		temp = (int*) malloc(sizeof(int));
-		read(fd, buf, READ_SIZE);
 		this_entry_pt = buf;
 
 		// process the read
@@ -132,65 +228,300 @@ void deregister_process(int pid){
 	}
 }
 
+// retune a registered process, the module switches at its next period boundary if the new mode fits
+void change_mode(int pid, unsigned cost, unsigned period){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, MODE_CHANGE_CMD_FORMAT, pid, cost, period);
+		printf("mode change cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// what the module does with a job of pid still running at its deadline: skip, late, abort or signal
+void set_overload_policy(int pid, char* policy){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, POLICY_CMD_FORMAT, pid, policy);
+		printf("overload policy cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// put pid in start set, its first release comes offset ms after the set starts, call before the first yield
+void set_release_offset(int pid, int set, unsigned offset){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, OFFSET_CMD_FORMAT, pid, set, offset);
+		printf("release offset cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// start a set: every task in it gets its first release at the same epoch plus its offset
+void start_release_set(int set){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, START_CMD_FORMAT, set);
+		printf("start set cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// register a reservation shared by the threads of process tgid
+void register_group(int tgid, unsigned cost, unsigned period){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, REGIST_GROUP_CMD_FORMAT, tgid, cost, period);
+		printf("register group cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// add thread tid of process tgid to the group reservation, then yield with tid as usual
+void join_group(int tgid, int tid){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, JOIN_GROUP_CMD_FORMAT, tgid, tid);
+		printf("join group cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// add process pid with its own cost & period to tenant server sid, then yield & deregister with pid as usual
+void register_child(int sid, int pid, unsigned cost, unsigned period){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, REGIST_CHILD_CMD_FORMAT, sid, pid, cost, period);
+		printf("register child cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// declare a fork-join task with workers threads, admitted once the last worker is declared
+void register_parallel(int id, unsigned period, unsigned workers){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, REGIST_PARALLEL_CMD_FORMAT, id, period, workers);
+		printf("register parallel cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// declare worker thread tid of the parallel task with the cost of its segment, then yield with tid as usual
+void join_parallel(int id, int tid, unsigned cost){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, JOIN_PARALLEL_CMD_FORMAT, id, tid, cost);
+		printf("join parallel cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// deregister the group reservation and all its threads
+void deregister_group(int tgid){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, DEREGIST_GROUP_CMD_FORMAT, tgid);
+		printf("deregister group cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// ask the module to fault in the whole address space of an admitted process
+void prefault_process(int pid){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, PREFAULT_CMD_FORMAT, pid);
+		printf("prefault cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// same, only for the region [start, start + len)
+void prefault_region(int pid, void* start, unsigned long len){
+	char* buf;
+
+	if(fd != -1){
+		buf = malloc(WRITE_SIZE);
+		sprintf(buf, PREFAULT_REGION_CMD_FORMAT, pid, (unsigned long) start, len);
+		printf("prefault region cmd [%s]\n", buf);
+		write(fd, buf, strlen(buf));
+		free(buf);
+	}
+}
+
+// lock the current and future pages of this process, so nothing is paged out between jobs
+bool lock_memory(void){
+	return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
 
 /*
 
-	Time Count helper function
-	I run them to determine the COST_BASE
+	Workload Engine
+
+	A job is a number of work units, calibrated so that one ms of requested cost
+	takes one ms of thread cpu time on this machine, whatever the compiler flags.
 
 */
 
+// results go to volatile sinks, so the loops can not be optimized away
+static volatile unsigned long cpu_sink = 1;
+static volatile size_t mem_sink = 0;
+// a random cyclic chain through MEM_BUF_SIZE bytes, one hop per cache line
+static size_t* mem_chain = NULL;
+
+// thread cpu time in microseconds
+long long thread_cpu_us(void){
+	struct timespec now;
 
-// suseconds_t == long
-// return the current microseconds time
-suseconds_t get_current_time(void){
-	struct timeval* temp;
-	suseconds_t ret;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return ((long long) now.tv_sec * NANOSEC + now.tv_nsec) / 1000;
+}
 
-	temp = malloc(sizeof(struct timeval));
-	gettimeofday(temp, NULL);
-	ret = temp->tv_usec;
-	free(temp);
+// cpu bound: a dependent multiply-add chain
+void cpu_unit(void){
+	unsigned long x;
+	int i;
 
-	return ret;
+	x = cpu_sink;
+	for(i = 0; i < CPU_UNIT_STEPS; i++){
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+	}
+	cpu_sink = x;
 }
 
-// calculate the duration of the job
-long calc_elapse(long current, long last){
-	if(current > last){
-		return current - last;
-	}else{
-		return current + (MICROSEC - last);
+// memory bound: dependent loads through the chain, each one most likely a cache miss
+void mem_unit(void){
+	size_t pos;
+	int i;
+
+	pos = mem_sink;
+	for(i = 0; i < MEM_UNIT_STEPS; i++){
+		pos = mem_chain[pos];
 	}
+	mem_sink = pos;
 }
 
-void fib(int amount);
+// mixed: half of each
+void mixed_unit(void){
+	cpu_unit();
+	mem_unit();
+}
 
-// the test program to determine COST_BASE
-void test(char* input){
+// link all the cache lines of the buffer into a single random cycle (Sattolo's algorithm),
+// only for the profiles that walk it. Return false if out of memory
+bool init_mem_chain(void){
+	size_t lines;
+	size_t* order;
+	size_t i;
+	size_t j;
+	size_t temp;
+
+	lines = MEM_BUF_SIZE / (CACHE_LINE_WORDS * sizeof(size_t));
+	mem_chain = malloc(MEM_BUF_SIZE);
+	order = malloc(lines * sizeof(size_t));
+	if(mem_chain == NULL || order == NULL){
+		free(mem_chain);
+		free(order);
+		mem_chain = NULL;
+		return false;
+	}
+
+	for(i = 0; i < lines; i++){
+		order[i] = i;
+	}
+	for(i = lines - 1; i > 0; i--){
+		j = rand() % i;
+		temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+	for(i = 0; i < lines; i++){
+		mem_chain[order[i] * CACHE_LINE_WORDS] = order[(i + 1) % lines] * CACHE_LINE_WORDS;
+	}
+	mem_sink = order[0] * CACHE_LINE_WORDS;
+
+	free(order);
+	return true;
+}
+
+// units of work per ms of thread cpu time
+double calibrate(void (*unit)(void)){
+	long long start;
+	long long elapsed;
+	long units;
 	int i;
-	int* job_amount;
-	long last;
-	long current;
-	long elapse;
 
-	printf("test for input [%s]\n", input);
+	// warm up the caches & the chain
+	for(i = 0; i < CALIBRATION_CHECK; i++){
+		unit();
+	}
 
+	units = 0;
+	start = thread_cpu_us();
+	do{
+		for(i = 0; i < CALIBRATION_CHECK; i++){
+			unit();
+		}
+		units += CALIBRATION_CHECK;
+		elapsed = thread_cpu_us() - start;
+	}while(elapsed < CALIBRATION_US);
 
-	job_amount = malloc(sizeof(int));
-	sscanf(input, "%d", job_amount);
+	return units * 1000.0 / elapsed;
+}
 
-	last = get_current_time();
-	printf("job starts\n");
+// run one job of cost_ms, return the thread cpu time it actually took in microseconds
+long long run_job(void (*unit)(void), double units_per_ms, int cost_ms){
+	long long start;
+	long units;
+	long i;
 
-	for(i = 0; i < ITERATION; i++){
-		fib(*job_amount);
-		current = get_current_time();
-		printf("job [%d] finished for [%ld]\n", i, calc_elapse(current, last));
-		last = current;
+	units = (long) (units_per_ms * cost_ms + 0.5);
+	start = thread_cpu_us();
+	for(i = 0; i < units; i++){
+		unit();
 	}
+	return thread_cpu_us() - start;
+}
 
-	free(job_amount);
+// microseconds from earlier to later
+long long timeval_diff_us(struct timeval* later, struct timeval* earlier){
+	return (long long) (later->tv_sec - earlier->tv_sec) * MICROSEC + (later->tv_usec - earlier->tv_usec);
 }
 
 /*
@@ -199,23 +530,49 @@ void test(char* input){
 
 */
 
-// some job: fib
-// duration: input * COST_BASE in milliseeconds
-void fib(int amount){
-	int j;
-	long fact;
-	// calculate factorial 50
-	fact = 1;
-	for(j = 1; j < amount * JOB_BASE; j++){
-		fact = fact * j;
+// SIGXCPU from the module under the signal overload policy: one per job past its deadline
+volatile sig_atomic_t overrun_signals = 0;
+
+void overrun_handler(int sig){
+	overrun_signals += 1;
+}
+
+// the overload policies the module knows, as in POLICY_OPTIONS
+const char* policy_names[POLICY_COUNT] = {"skip", "late", "abort", "signal"};
+
+bool is_policy(const char* name){
+	int i;
+
+	for(i = 0; i < POLICY_COUNT; i++){
+		if(strcmp(name, policy_names[i]) == 0){
+			return true;
+		}
 	}
+	return false;
+}
+
+void usage(void){
+	printf("usage: ./userapp [cost in ms] [period in ms] [iterations, default %d] [%s|%s|%s, default %s] [%s] [%s] [%s]\n"
+		"       ./userapp %s [set]\n",
+		ITERATION, PROFILE_CPU, PROFILE_MEM, PROFILE_MIXED, PROFILE_CPU, LOCK_OPTION, POLICY_OPTIONS, OFFSET_OPTION,
+		START_COMMAND);
 }
 
 int main(int argc, char* argv[]){
 	int period;
 	int cost;
-	int job_amount;
+	int iteration;
 	int pid;
+	// workload
+	char* profile;
+	void (*unit)(void);
+	double units_per_ms;
+	long long actual_us;
+	long long actual_total;
+	long long actual_max;
+	// page faults per job
+	struct rusage usage_before;
+	struct rusage usage_after;
 	int i;
 	// timing
 	struct timeval base;
@@ -223,34 +580,131 @@ int main(int argc, char* argv[]){
 	struct timeval yield;
 	long sec_count;
 	long usec_count;
+	// response time of each job, from the period boundary it was released at
+	long long release_us;
+	long long response_us;
+	long long response_total;
+	long long response_max;
+	int miss_count;
+	// admission query before registering
+	unsigned remaining;
+	unsigned max_cost;
+	// start set & release offset
+	int set;
+	unsigned offset;
+	bool in_set;
+
+	// the start command of a start set, no job
+	if(argc == 3 && strcmp(argv[1], START_COMMAND) == 0){
+		sscanf(argv[2], "%d", &set);
+		start_communicat();
+		start_release_set(set);
+		terminate_communicat();
+		return 0;
+	}
 
 	if(argc < 3){
-		printf("usage: ./userapp [cost in ms] [period in ms]\n");
+		usage();
 		return 0;
 	}
 
 	sscanf(argv[1], "%d", &cost);
-	job_amount = cost / COST_BASE;
 	sscanf(argv[2], "%d", &period);
+	iteration = ITERATION;
+	if(argc > 3){
+		sscanf(argv[3], "%d", &iteration);
+	}
+	profile = PROFILE_CPU;
+	if(argc > 4){
+		profile = argv[4];
+	}
 	pid = getpid();
 
+	// calibrate the job profile before registering, it is not part of any job
+	if(strcmp(profile, PROFILE_MEM) == 0){
+		unit = mem_unit;
+	}else if(strcmp(profile, PROFILE_MIXED) == 0){
+		unit = mixed_unit;
+	}else if(strcmp(profile, PROFILE_CPU) == 0){
+		unit = cpu_unit;
+	}else{
+		printf("unknown profile [%s]\n", profile);
+		usage();
+		return 1;
+	}
+
+	// check the trailing options up front, a typo must not leave a task registered
+	for(i = 5; i < argc; i++){
+		if(strcmp(argv[i], LOCK_OPTION) != 0 && sscanf(argv[i], OFFSET_OPTION_FORMAT, &set, &offset) != 2 &&
+			!is_policy(argv[i])){
+			printf("unknown option [%s]\n", argv[i]);
+			usage();
+			return 1;
+		}
+	}
+	srand(pid);
+	// the cpu profile never touches the chain, no 32MB to build & lock for it
+	if(unit != cpu_unit && !init_mem_chain()){
+		printf("job [%d] can not allocate the memory chain\n", pid);
+		printf(RESULT_FORMAT, pid, 0, cost, period, 0, 0, 0LL, 0LL);
+		return 1;
+	}
+	units_per_ms = calibrate(unit);
+
 	printf("run job [%d] with cost [%d ms] and period [%d ms]\n", pid, cost, period);
+	printf("job [%d] profile [%s] calibrated to [%.2f units/ms]\n", pid, profile, units_per_ms);
 
 	start_communicat();
 
+	// what-if first, registering is the real check
+	if(query_admission(cost, period, &remaining, &max_cost) || remaining != 0){
+		printf("job [%d] query: remaining load [%u] max cost at this period [%u ms]\n", pid, remaining, max_cost);
+	}
+
 	register_process(pid, cost, period);
 	if(!check_accepted(pid)){
 		printf("job [%d] rejected\n", pid);
+		printf(RESULT_FORMAT, pid, 0, cost, period, 0, 0, 0LL, 0LL);
+		terminate_communicat();
 		return 0;
 	}
 
-	// initial yield
+	// trailing options, in any order
+	in_set = false;
+	for(i = 5; i < argc; i++){
+		if(strcmp(argv[i], LOCK_OPTION) == 0){
+			// make the working set resident before the first job
+			if(!lock_memory()){
+				printf("job [%d] mlockall failed, prefault only\n", pid);
+			}
+			prefault_process(pid);
+		}else if(sscanf(argv[i], OFFSET_OPTION_FORMAT, &set, &offset) == 2){
+			set_release_offset(pid, set, offset);
+			in_set = true;
+		}else{
+			// a policy name, checked above
+			signal(SIGXCPU, overrun_handler);
+			set_overload_policy(pid, argv[i]);
+		}
+	}
+
+	// initial yield, in a start set the first release waits for the start & the offset,
+	// so the period boundaries count from the first wakeup
 	gettimeofday(&base, NULL);
 	yield_process(pid);
+	if(in_set){
+		gettimeofday(&base, NULL);
+	}
 	printf("job [%d] accepted\n", pid);
 
+	response_total = 0;
+	response_max = 0;
+	miss_count = 0;
+	actual_total = 0;
+	actual_max = 0;
+
 	// job loop
-	for(i = 0; i < ITERATION; i++){
+	for(i = 0; i < iteration; i++){
 		// wake up timing
 		gettimeofday(&wakeup, NULL);
 		sec_count = wakeup.tv_sec - base.tv_sec;
@@ -261,7 +715,16 @@ int main(int argc, char* argv[]){
 		}
 		printf("job [%d] iteration [%d] wakeup [%zu s %zu us] after the beginning\n", pid, i, sec_count, usec_count);
 
-		fib(job_amount);
+		getrusage(RUSAGE_SELF, &usage_before);
+		actual_us = run_job(unit, units_per_ms, cost);
+		getrusage(RUSAGE_SELF, &usage_after);
+		actual_total += actual_us;
+		if(actual_us > actual_max){
+			actual_max = actual_us;
+		}
+		printf("job [%d] iteration [%d] cost requested [%d us] actual [%lld us] faults minor [%ld] major [%ld]\n",
+			pid, i, cost * 1000, actual_us, usage_after.ru_minflt - usage_before.ru_minflt,
+			usage_after.ru_majflt - usage_before.ru_majflt);
 
 		// working timing
 		gettimeofday(&yield, NULL);
@@ -273,6 +736,18 @@ int main(int argc, char* argv[]){
 		}
 		printf("job [%d] iteration [%d] finished for [%zu s %zu us] after wakeup\n", pid, i, sec_count, usec_count);
 
+		// the job was released at the last period boundary before its wakeup
+		release_us = timeval_diff_us(&wakeup, &base);
+		release_us -= release_us % ((long long) period * 1000);
+		response_us = timeval_diff_us(&yield, &base) - release_us;
+		response_total += response_us;
+		if(response_us > response_max){
+			response_max = response_us;
+		}
+		if(response_us > (long long) period * 1000){
+			miss_count += 1;
+		}
+
 		yield_process(pid);
 	}
 
@@ -280,5 +755,14 @@ int main(int argc, char* argv[]){
 	printf("job [%d] finished\n", pid);
 	deregister_process(pid);
 
+	printf("job [%d] cost requested [%d us] actual avg [%lld us] max [%lld us]\n", pid, cost * 1000,
+		iteration == 0 ? 0LL : actual_total / iteration, actual_max);
+
+	printf("job [%d] overrun signals [%d]\n", pid, (int) overrun_signals);
+
+	printf(RESULT_FORMAT, pid, 1, cost, period, iteration, miss_count,
+		iteration == 0 ? 0LL : response_total / iteration, response_max);
+
 	terminate_communicat();
+	return 0;
 }
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mp3_stream.h"
+
+/*
+
+	analyze: fault rates, cpu utilization & completion times from a collect output file
+
+	usage: ./analyze [-s] [-g gap ms] [collect output file]
+
+	Aggregate & encoded records: a CSV row per sample with the curves of the report, against
+	jiffies from the start of the measurement period: accumulated minor & major faults, fault
+	rates (/s) and cpu utilization, (utime + stime) / wall time of the interval, 2.0 for two busy
+	cores. With -s, one row per measurement period instead: its completion time, fault totals &
+	rates, average cpu utilization and the load control decisions. A period starts at a gap of
+	more than gap ms (default 1000) between two samples.
+
+	Per-process records: a CSV row per record, or with -s one row per process: its completion
+	time (first to last record), fault totals & rates, cpu time and peak working set.
+
+*/
+
+#define DEFAULT_INPUT "profile.mp3s"
+#define DEFAULT_GAP_MS 1000
+#define MAX_PIDS 4096
+
+// one measurement period of aggregate samples
+typedef struct period_t {
+	int id;
+	unsigned long samples;
+	__u64 start_jiffies;
+	__u64 start_ns;
+	__u64 prev_jiffies;
+	__u64 prev_ns;
+
+	__u64 min_flt;
+	__u64 maj_flt;
+	__u64 cpu_time;
+	// the cpu time & wall time of the samples after the first, whose interval is known
+	__u64 rated_cpu_time;
+	__u64 rated_jiffies;
+	unsigned long missed;
+	unsigned long suspends;
+	unsigned long resumes;
+} period;
+
+// the records of one process
+typedef struct proc_summary_t {
+	__u32 pid;
+	unsigned long samples;
+	__u32 first_ms;
+	__u32 last_ms;
+	__u64 min_flt;
+	__u64 maj_flt;
+	__u64 cpu_time;
+	__u32 peak_wss;
+} proc_summary;
+
+static int summary = 0;
+static __u64 gap_ns = DEFAULT_GAP_MS * 1000000ULL;
+
+static period cur;
+static int period_count = 0;
+static proc_summary procs[MAX_PIDS];
+static int proc_count = 0;
+
+
+/*
+
+	Aggregate Samples
+
+*/
+void print_period(period* p){
+	double seconds;
+
+	if(p->samples == 0){
+		return;
+	}
+	seconds = (p->prev_ns - p->start_ns) / 1e9;
+	printf("%d,%lu,%llu,%.3f,%llu,%llu,%.1f,%.1f,%.4f,%lu,%lu,%lu\n", p->id, p->samples,
+		(unsigned long long) (p->prev_jiffies - p->start_jiffies), seconds,
+		(unsigned long long) p->min_flt, (unsigned long long) p->maj_flt,
+		seconds > 0 ? (p->min_flt + p->maj_flt) / seconds : 0.0, seconds > 0 ? p->maj_flt / seconds : 0.0,
+		p->rated_jiffies > 0 ? (double) p->rated_cpu_time / p->rated_jiffies : 0.0,
+		p->missed, p->suspends, p->resumes);
+}
+
+void on_row(const mp3_row* row, void* arg){
+	__u64 wall_jiffies;
+	double wall_s;
+
+	// a new measurement period
+	if(cur.samples == 0 || row->timestamp_ns - cur.prev_ns > gap_ns){
+		if(summary){
+			print_period(&cur);
+		}
+		memset(&cur, 0, sizeof(period));
+		cur.id = period_count++;
+		cur.start_jiffies = row->jiffies;
+		cur.start_ns = row->timestamp_ns;
+	}else{
+		cur.rated_cpu_time += row->cpu_time;
+		cur.rated_jiffies += row->jiffies - cur.prev_jiffies;
+	}
+
+	cur.min_flt += row->min_flt;
+	cur.maj_flt += row->maj_flt;
+	cur.cpu_time += row->cpu_time;
+	cur.missed += row->missed;
+
+	if(!summary){
+		// the interval of the first sample of a period is not known
+		if(cur.samples == 0){
+			printf("%llu,%llu,%llu,nan,nan,nan\n", 0ULL, (unsigned long long) cur.min_flt, (unsigned long long) cur.maj_flt);
+		}else{
+			wall_jiffies = row->jiffies - cur.prev_jiffies;
+			wall_s = (row->timestamp_ns - cur.prev_ns) / 1e9;
+			printf("%llu,%llu,%llu,%.1f,%.1f,%.4f\n", (unsigned long long) (row->jiffies - cur.start_jiffies),
+				(unsigned long long) cur.min_flt, (unsigned long long) cur.maj_flt,
+				wall_s > 0 ? (row->min_flt + row->maj_flt) / wall_s : 0.0, wall_s > 0 ? row->maj_flt / wall_s : 0.0,
+				wall_jiffies > 0 ? (double) row->cpu_time / wall_jiffies : 0.0);
+		}
+	}
+
+	cur.samples += 1;
+	cur.prev_jiffies = row->jiffies;
+	cur.prev_ns = row->timestamp_ns;
+}
+
+void on_event(__u32 event, __u32 pid, __u64 maj_rate, __u64 cpu_pct, __u64 timestamp_ns, void* arg){
+	if(event == MP3_EVENT_SUSPEND){
+		cur.suspends += 1;
+	}else{
+		cur.resumes += 1;
+	}
+	if(!summary){
+		printf("# %s %u major/s %llu cpu %llu%%\n", event == MP3_EVENT_SUSPEND ? "suspend" : "resume",
+			pid, (unsigned long long) maj_rate, (unsigned long long) cpu_pct);
+	}
+}
+
+// one fixed size aggregate record
+void aggregate_record(const mp3_sample* sample){
+	mp3_row row;
+
+	if(sample->jiffies == MP3_EVENT_MARK){
+		on_event(sample->missed, sample->min_flt, sample->maj_flt, sample->cpu_time, sample->timestamp_ns, NULL);
+		return;
+	}
+
+	row.jiffies = sample->jiffies;
+	row.min_flt = sample->min_flt;
+	row.maj_flt = sample->maj_flt;
+	row.cpu_time = sample->cpu_time;
+	row.timestamp_ns = sample->timestamp_ns;
+	row.missed = sample->missed;
+	row.late_us = sample->late_us;
+	on_row(&row, NULL);
+}
+
+
+/*
+
+	Per-process Samples
+
+*/
+proc_summary* find_proc(__u32 pid){
+	int i;
+
+	for(i = 0; i < proc_count; i++){
+		if(procs[i].pid == pid){
+			return &procs[i];
+		}
+	}
+	if(proc_count == MAX_PIDS){
+		return NULL;
+	}
+	memset(&procs[proc_count], 0, sizeof(proc_summary));
+	procs[proc_count].pid = pid;
+	return &procs[proc_count++];
+}
+
+void process_record(const mp3_proc_sample* sample){
+	proc_summary* proc;
+
+	if(sample->pid == 0){
+		// a load control event
+		if(!summary){
+			printf("# %s %u major/s %u cpu %u%%\n", sample->maj_flt == MP3_EVENT_SUSPEND ? "suspend" : "resume",
+				sample->min_flt, sample->wss_pages, sample->cpu_time);
+		}
+		return;
+	}
+
+	if(!summary){
+		printf("%u,%u,%u,%u,%u,%u,%d\n", sample->time_ms, sample->pid, sample->min_flt, sample->maj_flt,
+			sample->cpu_time, sample->wss_pages, sample->wss_delta);
+		return;
+	}
+
+	proc = find_proc(sample->pid);
+	if(proc == NULL){
+		return;
+	}
+	if(proc->samples == 0){
+		proc->first_ms = sample->time_ms;
+	}
+	proc->samples += 1;
+	proc->last_ms = sample->time_ms;
+	proc->min_flt += sample->min_flt;
+	proc->maj_flt += sample->maj_flt;
+	proc->cpu_time += sample->cpu_time;
+	if(sample->wss_pages > proc->peak_wss){
+		proc->peak_wss = sample->wss_pages;
+	}
+}
+
+void print_procs(void){
+	double seconds;
+	int i;
+
+	for(i = 0; i < proc_count; i++){
+		seconds = (procs[i].last_ms - procs[i].first_ms) / 1e3;
+		printf("%u,%lu,%u,%.3f,%llu,%llu,%.1f,%.1f,%llu,%u\n", procs[i].pid, procs[i].samples, procs[i].first_ms,
+			seconds, (unsigned long long) procs[i].min_flt, (unsigned long long) procs[i].maj_flt,
+			seconds > 0 ? (procs[i].min_flt + procs[i].maj_flt) / seconds : 0.0,
+			seconds > 0 ? procs[i].maj_flt / seconds : 0.0,
+			(unsigned long long) procs[i].cpu_time, procs[i].peak_wss);
+	}
+}
+
+
+int main(int argc, char* argv[]){
+	mp3_stream_header header;
+	mp3_decoder dec;
+	char record[sizeof(mp3_sample)];
+	char* input;
+	unsigned gap_ms;
+	FILE* in;
+	int opt;
+	int c;
+
+	gap_ms = DEFAULT_GAP_MS;
+	while((opt = getopt(argc, argv, "sg:")) != -1){
+		switch(opt){
+			case 's': summary = 1; break;
+			case 'g':
+				sscanf(optarg, "%u", &gap_ms);
+				gap_ns = gap_ms * 1000000ULL;
+				break;
+			default:
+				printf("usage: ./analyze [-s] [-g gap ms] [collect output file]\n");
+				return 1;
+		}
+	}
+	input = optind < argc ? argv[optind] : DEFAULT_INPUT;
+
+	in = fopen(input, "rb");
+	if(in == NULL){
+		printf("file open error. %s\n", input);
+		return 1;
+	}
+	if(fread(&header, sizeof(header), 1, in) != 1 || header.magic != MP3_STREAM_MAGIC
+		|| header.version != MP3_BUF_VERSION || header.record_size > sizeof(record)){
+		printf("not a collect output file of this version\n");
+		fclose(in);
+		return 1;
+	}
+
+	// a large buffer, the file is read sequentially
+	setvbuf(in, NULL, _IOFBF, 1 << 20);
+
+	switch(header.mode){
+		case MP3_MODE_PROCESS:
+			if(summary){
+				printf("pid,samples,start_ms,completion_s,min_flt,maj_flt,fault_rate,maj_rate,cpu_time,peak_wss\n");
+			}else{
+				printf("time_ms,pid,min_flt,maj_flt,cpu_time,wss_pages,wss_delta\n");
+			}
+			while(fread(record, header.record_size, 1, in) == 1){
+				process_record((mp3_proc_sample*) record);
+			}
+			if(summary){
+				print_procs();
+			}
+			break;
+
+		case MP3_MODE_AGGREGATE:
+		case MP3_MODE_ENCODED:
+			if(summary){
+				printf("period,samples,completion_jiffies,completion_s,min_flt,maj_flt,fault_rate,maj_rate,"
+					"avg_cpu_util,missed,suspends,resumes\n");
+			}else{
+				printf("jiffies,min_flt_total,maj_flt_total,fault_rate,maj_rate,cpu_util\n");
+			}
+			if(header.mode == MP3_MODE_ENCODED){
+				mp3_decoder_init(&dec, on_row, on_event, NULL);
+				while((c = getc(in)) != EOF){
+					if(mp3_decode_byte(&dec, (unsigned char) c) < 0){
+						printf("unknown record type\n");
+						break;
+					}
+				}
+			}else{
+				while(fread(record, header.record_size, 1, in) == 1){
+					aggregate_record((mp3_sample*) record);
+				}
+			}
+			if(summary){
+				print_period(&cur);
+			}
+			break;
+
+		default:
+			printf("unknown mode %u\n", header.mode);
+	}
+
+	fclose(in);
+	return 0;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include "mp3_stream.h"
+
+/*
+
+	collect: streams the profiler ring to a file, for analyze
+
+	usage: ./collect [-f] [-t wake threshold] [-o output file] device file
+
+	The records are written as they are in the mapped ring, no formatting: one write() per
+	contiguous span straight from the mapping, so a batch of records costs one or two system
+	calls. Between batches it sleeps in poll() until the module has wake threshold records
+	(see "T" in /proc/mp3/status), so the larger the threshold, the fewer wake ups.
+	Without -f, it stops when the current measurement period ends, with -f on SIGINT or SIGTERM.
+
+	The output is one mp3_stream_header, then the records, see mp3_stream.h.
+
+*/
+
+#define DEFAULT_OUTPUT "profile.mp3s"
+#define PROC_STATUS "/proc/mp3/status"
+
+static volatile sig_atomic_t stopping = 0;
+
+void on_signal(int sig){
+	stopping = 1;
+}
+
+// the module publishes head & seq with release stores, pair them with acquire loads. tail is ours
+static __u32 load_acquire(__u32* ptr){
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(__u32* ptr, __u32 value){
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+// the whole buffer, return it or NULL. The header says how many pages to map
+mp3_buf_header* map_buffer(int dev_fd, size_t* len){
+	mp3_buf_header* header;
+	__u32 pages;
+
+	header = mmap(NULL, MP3_BUF_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, dev_fd, 0);
+	if(header == MAP_FAILED){
+		return NULL;
+	}
+	if(header->magic != MP3_BUF_MAGIC || header->version != MP3_BUF_VERSION){
+		printf("unknown profiler buffer layout\n");
+		munmap(header, MP3_BUF_PAGE_SIZE);
+		return NULL;
+	}
+	pages = header->pages;
+	munmap(header, MP3_BUF_PAGE_SIZE);
+
+	*len = (size_t) pages * MP3_BUF_PAGE_SIZE;
+	header = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, dev_fd, 0);
+	if(header == MAP_FAILED){
+		return NULL;
+	}
+	return header;
+}
+
+// write it all, or -1
+int write_all(int fd, const char* data, size_t len){
+	ssize_t ret;
+
+	while(len > 0){
+		ret = write(fd, data, len);
+		if(ret < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return -1;
+		}
+		data += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+// the wake threshold of the device, in records
+void set_wake_threshold(unsigned threshold){
+	FILE* status;
+
+	status = fopen(PROC_STATUS, "w");
+	if(status == NULL){
+		printf("can not set the wake threshold\n");
+		return;
+	}
+	fprintf(status, "T %u", threshold);
+	fclose(status);
+}
+
+int main(int argc, char* argv[]){
+	mp3_stream_header file_header;
+	mp3_buf_header* header;
+	char* ring;
+	char* output;
+	char record[sizeof(mp3_sample)];
+	struct pollfd pfd;
+	struct sigaction action;
+	size_t map_len;
+	__u32 head;
+	__u32 tail;
+	__u32 seq;
+	__u32 index;
+	__u32 span;
+	unsigned long long records;
+	unsigned threshold;
+	int follow;
+	int dev_fd;
+	int out_fd;
+	int opt;
+
+	output = DEFAULT_OUTPUT;
+	follow = 0;
+	threshold = 0;
+	while((opt = getopt(argc, argv, "ft:o:")) != -1){
+		switch(opt){
+			case 'f': follow = 1; break;
+			case 't': sscanf(optarg, "%u", &threshold); break;
+			case 'o': output = optarg; break;
+			default:
+				printf("usage: ./collect [-f] [-t wake threshold] [-o output file] device file\n");
+				return 1;
+		}
+	}
+	if(optind != argc - 1){
+		printf("usage: ./collect [-f] [-t wake threshold] [-o output file] device file\n");
+		return 1;
+	}
+
+	dev_fd = open(argv[optind], O_RDWR);
+	if(dev_fd < 0){
+		printf("file open error. %s\n", argv[optind]);
+		return 1;
+	}
+	header = map_buffer(dev_fd, &map_len);
+	if(header == NULL){
+		close(dev_fd);
+		return 1;
+	}
+	ring = (char*) header + MP3_BUF_DATA_OFFSET;
+
+	out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out_fd < 0){
+		printf("file open error. %s\n", output);
+		return 1;
+	}
+	file_header.magic = MP3_STREAM_MAGIC;
+	file_header.version = header->version;
+	file_header.mode = header->mode;
+	file_header.record_size = header->record_size;
+	if(write_all(out_fd, (char*) &file_header, sizeof(file_header)) < 0){
+		perror("write");
+		return 1;
+	}
+
+	if(threshold != 0){
+		set_wake_threshold(threshold);
+	}
+
+	// no SA_RESTART: a signal wakes poll() up
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	records = 0;
+	tail = header->tail;
+	while(1){
+		// seq before head: the module ends a period after its last record, so nothing is missed below
+		seq = load_acquire(&header->seq);
+		head = load_acquire(&header->head);
+
+		if(head == tail){
+			if(stopping || (!follow && (seq & 1) == 0)){
+				break;
+			}
+
+			pfd.fd = dev_fd;
+			pfd.events = POLLIN;
+			if(poll(&pfd, 1, -1) < 0 && errno != EINTR){
+				break;
+			}
+			if(stopping || load_acquire(&header->head) != tail){
+				continue;
+			}
+
+			// readable with nothing in the ring: a period ended, read() reports it once and clears it.
+			// It may also return a record that just came in
+			if(read(dev_fd, record, header->record_size) == header->record_size){
+				if(write_all(out_fd, record, header->record_size) < 0){
+					perror("write");
+					goto out;
+				}
+				tail++;
+				records++;
+			}
+			continue;
+		}
+
+		// at most two spans, the ring may wrap
+		while(tail != head){
+			index = tail & (header->capacity - 1);
+			span = head - tail;
+			if(span > header->capacity - index){
+				span = header->capacity - index;
+			}
+			if(write_all(out_fd, ring + (size_t) index * header->record_size, (size_t) span * header->record_size) < 0){
+				perror("write");
+				goto out;
+			}
+			tail += span;
+			records += span;
+		}
+		// hand the slots back only after they are written
+		store_release(&header->tail, tail);
+	}
+
+out:
+	fprintf(stderr, "%llu records, %llu bytes\n", records, records * header->record_size);
+	if(header->dropped != 0){
+		fprintf(stderr, "%u records dropped while the ring was full\n", header->dropped);
+	}
+
+	close(out_fd);
+	munmap(header, map_len);
+	close(dev_fd);
+	return 0;
+}
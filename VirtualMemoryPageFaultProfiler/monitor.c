@@ -8,20 +8,22 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 
-#define NPAGES (128)   // The size of profiler buffer (Unit: memory page)
-#define BUFD_MAX 48000 // The max number of profiled samples stored in the profiler buffer
+#include "mp3_stream.h"
 
 static int buf_fd = -1;
 static int buf_len;
 
-// This function opens a character device (which is pointed by a file named as fname) and performs the mmap() operation. If the operations are successful, the base address of memory mapped buffer is returned. Otherwise, a NULL pointer is returned.
-void *buf_init(char *fname)
+// This function opens a character device (which is pointed by a file named as fname) and performs the mmap() operation on its first npages pages. If the operations are successful, the base address of memory mapped buffer is returned. Otherwise, a NULL pointer is returned.
+void *buf_init(char *fname, int npages)
 {
   unsigned int *kadr;
 
+  buf_len = npages * getpagesize();
   if(buf_fd == -1){
-    buf_len = NPAGES * getpagesize();
     if ((buf_fd=open(fname, O_RDWR|O_SYNC))<0){
         printf("file open error. %s\n", fname);
         return NULL;
@@ -45,47 +47,285 @@ void buf_exit()
   }
 }
 
+// The module publishes head & seq with release stores, pair them with acquire loads. tail is ours.
+static __u32 load_acquire(__u32 *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(__u32 *ptr, __u32 value)
+{
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static void print_row(const mp3_row *row, void *arg)
+{
+  printf("%ld %ld %ld %ld %llu %u %u\n", (long) row->jiffies, (long) row->min_flt, (long) row->maj_flt,
+         (long) row->cpu_time, (unsigned long long) row->timestamp_ns, row->missed, row->late_us);
+}
+
+// A load control event, see MP3_EVENT_* in mp3_buf.h. It is not a sample, so not counted as a row
+static void print_event(__u32 event, __u32 pid, __u64 maj_rate, __u64 cpu_pct, __u64 timestamp_ns, void *arg)
+{
+  printf("# %s %u major/s %llu cpu %llu%% at %llu\n", event == MP3_EVENT_SUSPEND ? "suspend" : "resume",
+         pid, (unsigned long long) maj_rate, (unsigned long long) cpu_pct, (unsigned long long) timestamp_ns);
+}
+
+// The decoder of the encoded mode, see mp3_stream.h
+static mp3_decoder dec;
+
+// One record of the ring, return the rows printed
+static long print_sample(mp3_buf_header *header, void *record)
+{
+  mp3_sample *sample;
+  mp3_proc_sample *proc;
+  mp3_row row;
+  long rows;
+
+  if(header->mode == MP3_MODE_ENCODED){
+    rows = mp3_decode_byte(&dec, *(unsigned char *) record);
+    if(rows < 0){
+      printf("unknown record type\n");
+      return 0;
+    }
+    return rows;
+  }
+
+  if(header->mode == MP3_MODE_PROCESS){
+    proc = record;
+    if(proc->pid == 0){
+      print_event(proc->maj_flt, proc->min_flt, proc->wss_pages, proc->cpu_time, proc->time_ms * 1000000ULL, NULL);
+      return 0;
+    }
+    printf("%u %u %u %u %u %u %d\n", proc->time_ms, proc->pid, proc->min_flt, proc->maj_flt, proc->cpu_time,
+           proc->wss_pages, proc->wss_delta);
+    return 1;
+  }
+
+  sample = record;
+  if(sample->jiffies == MP3_EVENT_MARK){
+    print_event(sample->missed, sample->min_flt, sample->maj_flt, sample->cpu_time, sample->timestamp_ns, NULL);
+    return 0;
+  }
+  row.jiffies = sample->jiffies;
+  row.min_flt = sample->min_flt;
+  row.maj_flt = sample->maj_flt;
+  row.cpu_time = sample->cpu_time;
+  row.timestamp_ns = sample->timestamp_ns;
+  row.missed = sample->missed;
+  row.late_us = sample->late_us;
+  print_row(&row, NULL);
+  return 1;
+}
+
+static const char *heat_types[] = { "anon", "file", "heap", "stack" };
+
+static __u64 heat_sum(__u32 *buckets)
+{
+  __u64 sum = 0;
+  int b;
+
+  for(b = 0; b < MP3_HEAT_BUCKETS; b++)
+    sum += buckets[b];
+  return sum;
+}
+
+static int heat_cmp(const void *a, const void *b)
+{
+  __u64 major_a = heat_sum(((mp3_vma_heat *) a)->major);
+  __u64 major_b = heat_sum(((mp3_vma_heat *) b)->major);
+
+  if(major_a != major_b)
+    return major_a < major_b ? 1 : -1;
+  return heat_sum(((mp3_vma_heat *) a)->minor) < heat_sum(((mp3_vma_heat *) b)->minor) ? 1 : -1;
+}
+
+// Take a snapshot of the fault heatmap (heatmap=1 module parameter) and print it, most major faults first.
+// One line per VMA, then the faults of every bucket with any, as "offset minor major"
+static int print_heatmap(char *fname)
+{
+  mp3_heat_snapshot snapshot;
+  mp3_vma_heat *vmas;
+  __u32 v;
+  int b;
+
+  if ((buf_fd=open(fname, O_RDWR))<0){
+    printf("file open error. %s\n", fname);
+    return -1;
+  }
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.capacity = 256;
+  vmas = calloc(snapshot.capacity, sizeof(mp3_vma_heat));
+  snapshot.records = (__u64) (unsigned long) vmas;
+  if(ioctl(buf_fd, MP3_IOC_HEAT_SNAPSHOT, &snapshot) < 0){
+    perror("heatmap snapshot");
+    free(vmas);
+    buf_exit();
+    return -1;
+  }
+
+  qsort(vmas, snapshot.count, sizeof(mp3_vma_heat), heat_cmp);
+  for(v = 0; v < snapshot.count; v++){
+    printf("%u %llx-%llx %s %s minor %llu major %llu\n", vmas[v].pid,
+           (unsigned long long) vmas[v].vm_start, (unsigned long long) vmas[v].vm_end,
+           vmas[v].type < 4 ? heat_types[vmas[v].type] : "?", vmas[v].path,
+           (unsigned long long) heat_sum(vmas[v].minor), (unsigned long long) heat_sum(vmas[v].major));
+    for(b = 0; b < MP3_HEAT_BUCKETS; b++){
+      if(vmas[v].minor[b] != 0 || vmas[v].major[b] != 0)
+        printf("  +%llx %u %u\n", (unsigned long long) (b * vmas[v].bucket_size), vmas[v].minor[b], vmas[v].major[b]);
+    }
+  }
+  if(snapshot.total > snapshot.count)
+    fprintf(stderr, "%u of %u VMAs shown\n", snapshot.count, snapshot.total);
+  if(snapshot.dropped != 0)
+    fprintf(stderr, "%u faults not counted\n", snapshot.dropped);
+
+  free(vmas);
+  buf_exit();
+  return 0;
+}
+
+// A consistent copy of a rollup slot: seq even & unchanged around the copy
+static void copy_rollup_slot(mp3_rollup_slot *slot, mp3_rollup_slot *copy)
+{
+  __u32 seq;
+
+  do{
+    seq = load_acquire(&slot->seq);
+    memcpy(copy, slot, sizeof(mp3_rollup_slot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  }while((seq & 1) || seq != __atomic_load_n(&slot->seq, __ATOMIC_RELAXED));
+}
+
+// Print the history of every rollup level, oldest first: resolution (ms), window start (ns), samples, then
+// sum & max of minor faults, major faults & cpu time. The last window of a level is still being filled
+static void print_rollups(mp3_buf_header *header)
+{
+  mp3_rollup *rollups = (mp3_rollup *) ((char *) header + MP3_BUF_ROLLUP_OFFSET);
+  mp3_rollup_slot slot;
+  __u32 head, n;
+  int level;
+
+  for(level = 0; level < MP3_ROLLUP_LEVELS; level++){
+    head = load_acquire(&rollups[level].head);
+    n = head >= MP3_ROLLUP_SLOTS - 1 ? head - (MP3_ROLLUP_SLOTS - 1) : 0;
+    for(; n <= head; n++){
+      copy_rollup_slot(&rollups[level].slots[n % MP3_ROLLUP_SLOTS], &slot);
+      if(slot.count == 0)
+        continue;
+      printf("%u %llu %u %llu %llu %llu %llu %llu %llu%s\n", rollups[level].resolution_ms,
+             (unsigned long long) slot.start_ns, slot.count,
+             (unsigned long long) slot.sum[MP3_ROLLUP_MIN_FLT], (unsigned long long) slot.max[MP3_ROLLUP_MIN_FLT],
+             (unsigned long long) slot.sum[MP3_ROLLUP_MAJ_FLT], (unsigned long long) slot.max[MP3_ROLLUP_MAJ_FLT],
+             (unsigned long long) slot.sum[MP3_ROLLUP_CPU_TIME], (unsigned long long) slot.max[MP3_ROLLUP_CPU_TIME],
+             n == head ? " partial" : "");
+    }
+  }
+}
+
+// Usage: ./monitor [-f | -m | -r] [device file]
+// Without -f, it drains the ring and keeps streaming until the current measurement period ends.
+// With -f, it keeps streaming across measurement periods until it is killed.
+// With -m, it prints the fault heatmap instead and exits.
+// With -r, it prints the rollups instead and exits.
 int main(int argc, char* argv[])
 {
-  long *buf;
-  int index = 0;
-  int i;
+  mp3_buf_header *header;
+  char *ring;
+  mp3_sample sample;  // the largest record
+  struct pollfd pfd;
+  char *fname = "node";
+  int follow = 0;
+  int heatmap = 0;
+  int rollups = 0;
+  __u32 head, tail, seq;
+  long i;
+  int arg;
+  int npages;
 
-  // Open the char device and mmap()
-  buf = buf_init("node");
-  if(!buf)
+  for(arg = 1; arg < argc; arg++){
+    if(strcmp(argv[arg], "-f") == 0)
+      follow = 1;
+    else if(strcmp(argv[arg], "-m") == 0)
+      heatmap = 1;
+    else if(strcmp(argv[arg], "-r") == 0)
+      rollups = 1;
+    else
+      fname = argv[arg];
+  }
+
+  if(heatmap)
+    return print_heatmap(fname);
+
+  // Open the char device and mmap() the header, then the whole buffer it describes
+  header = buf_init(fname, 1);
+  if(!header)
     return -1;
-  
-  // Read and print profiled data
-  for(index=0; index<BUFD_MAX; index++)
-    if(buf[index] != -1) break;
 
+  if(header->magic != MP3_BUF_MAGIC || header->version != MP3_BUF_VERSION
+     || header->record_size > sizeof(sample)){
+    printf("unknown profiler buffer layout\n");
+    buf_exit();
+    return -1;
+  }
+  npages = header->pages;
+  munmap(header, buf_len);
+
+  header = buf_init(fname, npages);
+  if(!header)
+    return -1;
+  ring = (char *) header + MP3_BUF_DATA_OFFSET;
+  mp3_decoder_init(&dec, print_row, print_event, NULL);
+
+  if(rollups){
+    print_rollups(header);
+    buf_exit();
+    return 0;
+  }
+
+  // Read and print profiled data
   i = 0;
-  while(buf[index] != -1){
-    printf("%ld ", buf[index]);
-    buf[index++] = -1;
-    if(index >= BUFD_MAX)
-      index = 0;
-
-    printf("%ld ", buf[index]);
-    buf[index++] = -1;
-    if(index >= BUFD_MAX)
-      index = 0;
-
-    printf("%ld ", buf[index]);
-    buf[index++] = -1;
-    if(index >= BUFD_MAX)
-      index = 0;
-
-    printf("%ld\n", buf[index]);
-    buf[index++] = -1;
-    if(index >= BUFD_MAX)
-      index = 0;
-    i++;
+  tail = header->tail;
+  while(1){
+    // seq before head: the module ends a period after its last record, so nothing is missed below
+    seq = load_acquire(&header->seq);
+    head = load_acquire(&header->head);
+
+    if(head == tail){
+      if(!follow && (seq & 1) == 0)
+        break;
+      fflush(stdout);
+
+      // Sleep until enough samples are ready or the period ends, see the wake threshold in mp3.c
+      pfd.fd = buf_fd;
+      pfd.events = POLLIN;
+      if(poll(&pfd, 1, -1) < 0)
+        break;
+      if(load_acquire(&header->head) != tail)
+        continue;
+
+      // Readable with nothing in the ring: a period ended, read() reports it once and clears it.
+      // It may also return a sample that just came in
+      if(read(buf_fd, &sample, header->record_size) == header->record_size){
+        i += print_sample(header, &sample);
+        tail++;
+      }
+      continue;
+    }
+
+    while(tail != head){
+      i += print_sample(header, ring + (tail & (header->capacity - 1)) * header->record_size);
+      tail++;
+    }
+    // Hand the slots back only after they are printed
+    store_release(&header->tail, tail);
   }
-  printf("read %d profiled data\n", i);
+  printf("read %ld profiled data\n", i);
+  if(header->dropped != 0)
+    fprintf(stderr, "%u records dropped while the ring was full\n", header->dropped);
 
   // Close the char device
   buf_exit();
+  return 0;
 }
-
@@ -1,29 +1,49 @@
 #define LINUX
 
 #include "mp3_given.h"
+#include "mp3_buf.h"
 // module
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
 // mem allocation
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 // proc file 
 #include <linux/fs.h>
 #include <linux/proc_fs.h>
-// linked list, pcb, lock
+// linked list, pcb, lock, shards
+#include <linux/cpumask.h>
+#include <linux/atomic.h>
 #include <linux/list.h>
+#include <linux/rculist.h>
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 // vmalloc, PG_reserved
 #include <linux/vmalloc.h>
 #include <linux/page-flags.h>
 #include <linux/mm.h>
-// delayed work queue
+// working set scan
+#include <linux/huge_mm.h>
+#include <asm/tlbflush.h>
+// work queue & the sampling timer
 #include <linux/jiffies.h>
 #include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
 // character device
 #include <linux/device.h>
 #include <linux/mm_types.h>
+// blocking read & poll
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mutex.h>
+// fault heatmap
+#include <linux/kprobes.h>
+#include <linux/file.h>
+#include <linux/dcache.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("ziangw2");
@@ -42,6 +62,7 @@ struct kmem_cache *mp3_write_buf_slab = NULL;
 // proc file system names & globals
 #define PROC_DIR_NAME 		"mp3"
 #define PROC_FILE_NAME 		"status"
+#define PROC_SITES_NAME 	"sites"
 #define PROC_READ_BUF_SIZE 	1024
 #define PROC_WRITE_BUF_SIZE 32
 // proc_read flag
@@ -50,46 +71,132 @@ struct kmem_cache *mp3_write_buf_slab = NULL;
 // proc fs entry - for create and delete
 static struct proc_dir_entry *mp3_proc_dir = NULL;
 static struct proc_dir_entry *mp3_proc_entry = NULL;
+static struct proc_dir_entry *mp3_sites_entry = NULL;
 // command format
 #define CMD_FORMAT_REGIST 	"R %d"
 #define CMD_FORMAT_UNREGIST "U %d"
+#define CMD_FORMAT_THRESHOLD "T %u"
+#define CMD_FORMAT_INTERVAL "I %u"
 
 
 // linked list entry
 typedef struct mp3_list_entry_t {
 	struct list_head head;
 
+	// a counted reference, taken at registration & dropped when the entry is freed
 	struct task_struct *pcb_ptr;
 	int pid;
+	// the entry is freed after a grace period, the sampler may still be looking at it
+	struct rcu_head rcu;
 
+	// baselines: the counters of the task at the last sample, the task itself is never modified
 	unsigned long cpu_util;
 	unsigned long major_fault_count;
 	unsigned long minor_fault_count;
+
+	// working set scan, only the shard's work touches these: the next address of the pass running
+	// (0 between passes), the young pages found so far, when it started, & the last estimate
+	unsigned long wss_addr;
+	unsigned long wss_young;
+	ktime_t wss_pass_start;
+	unsigned wss_passes;
+	unsigned long wss_pages;
+	long wss_delta;
+
+	// stopped by the load control: 0 if not, otherwise the order it got stopped in, list_lock held
+	unsigned suspended;
 } mp3_list_entry;
 // access marcos
 #define list_head_ptr(entry) ( &(entry->head) )
+
+// the registry is sharded by pid over the online cpus, each shard sampled by a work item on its cpu
+#define SHARD_STAGE_RECORDS 64 // per-process records staged before they go to the ring
+typedef struct mp3_shard_t {
+	// an RCU list of mp3_list_entry
+	struct list_head list;
+	unsigned length;
+
+	struct work_struct work;
+	int cpu;
+
+	// the current round: the sums of the shard & whether a task exited
+	unsigned long acc_cpu_util;
+	unsigned long acc_maj_flt;
+	unsigned long acc_min_flt;
+	bool exited;
+
+	// per-process records, copied to the ring in batches
+	mp3_proc_sample *stage;
+	unsigned staged;
+
+	// the working set scan: the position in the list of the entry the last round's budget ran out on
+	unsigned wss_next;
+} ____cacheline_aligned_in_smp mp3_shard;
+static mp3_shard *shards = NULL;
+static unsigned shard_count = 0;
 // entry count
 static unsigned mp3_list_length = 0;
-// the mp3 linked list & list lock
-static mp3_list_entry *regist_head = NULL;
+// the list lock: for the writers only, the samplers & the proc read traverse the shards under rcu_read_lock()
 static spinlock_t list_lock;
 
 
-// 128 * 4KB memory buffer
-#define VIRTUAL_BUF_PAGE_NUM	128
-#define VM_PAGE_SIZE 			4096
-#define VIRTUAL_BUF_SIZE 		(VIRTUAL_BUF_PAGE_NUM * VM_PAGE_SIZE)
+// buf_pages * 4KB memory buffer: the header page & the sample ring, see mp3_buf.h
+#define VM_PAGE_SIZE 			MP3_BUF_PAGE_SIZE
+static unsigned buf_pages = MP3_BUF_PAGE_NUM;
+module_param(buf_pages, uint, 0444);
+MODULE_PARM_DESC(buf_pages, "size of the profiler buffer in pages, header included (default 128)");
+// one record per live process & sampling round instead of one per round
+static bool per_process = false;
+module_param(per_process, bool, 0444);
+MODULE_PARM_DESC(per_process, "write per-process records instead of the aggregate ones (default 0)");
+// the aggregate records as varints, deltas & runs of idle rows, see MP3_ENC_* in mp3_buf.h
+static bool encoded = false;
+module_param(encoded, bool, 0444);
+MODULE_PARM_DESC(encoded, "write the aggregate records in the compact encoding (default 0, ignored with per_process)");
+// working set estimation: a pass over the page tables every window, at most budget ptes per shard & round
+static unsigned wss_window = 0;
+module_param(wss_window, uint, 0444);
+MODULE_PARM_DESC(wss_window, "working set scan window in ms, per_process only (default 0: off)");
+static unsigned wss_budget = 4096;
+module_param(wss_budget, uint, 0444);
+MODULE_PARM_DESC(wss_budget, "ptes scanned per shard and sampling round at most, over all its entries (default 4096)");
+// thrashing control: the thresholds can be changed in /sys/module/ziangw2_MP3/parameters
+static bool load_control = false;
+module_param(load_control, bool, 0444);
+MODULE_PARM_DESC(load_control, "stop registered processes while the system thrashes (default 0)");
+static unsigned thrash_maj_rate = 200;
+module_param(thrash_maj_rate, uint, 0644);
+MODULE_PARM_DESC(thrash_maj_rate, "major faults/s of the registered processes at which they thrash (default 200)");
+static unsigned thrash_cpu = 50;
+module_param(thrash_cpu, uint, 0644);
+MODULE_PARM_DESC(thrash_cpu, "cpu utilization (%) at or below which they thrash, of one cpu per process not stopped (default 50)");
+static unsigned thrash_hold = 10;
+module_param(thrash_hold, uint, 0644);
+MODULE_PARM_DESC(thrash_hold, "rounds of thrashing before a process is stopped, of calm before one is resumed (default 10)");
 static char *virtual_mem_buf = NULL;
-// filled sample count
-static unsigned MAX_SAMPLE_ALLOWED = ( VIRTUAL_BUF_SIZE / (4*sizeof(unsigned long)) );
-static unsigned sampling_count = 0;
-static unsigned long *sampling_position_ptr = NULL;
+static mp3_buf_header *buf_header = NULL;
+static char *buf_ring = NULL;
+static mp3_rollup *buf_rollups = NULL;
 
 
 // work queue & memory
-#define WQ_TIME_INTERVAL 50 // ms
+#define WQ_TIME_INTERVAL 	50 // ms, default
+#define WQ_MIN_INTERVAL 	1 // ms
 static struct workqueue_struct *mp3_wq = NULL;
-static struct delayed_work *mp3_work_ptr = NULL;
+// the sampling timer: absolute deadlines, interval * n after the period started, so no drift
+static struct hrtimer sample_timer;
+static unsigned sample_interval = WQ_TIME_INTERVAL;
+// the deadlines missed since the last round, the timer runs in irq context
+static spinlock_t sample_lock;
+static unsigned sample_missed = 0;
+// the round in progress: the shards not done yet, its deadline, when it started & the deadlines missed
+// before it. Set by the timer only when no round is in progress, read by the shards
+static atomic_t shards_pending = ATOMIC_INIT(0);
+static ktime_t round_deadline;
+static ktime_t round_start;
+static unsigned round_missed = 0;
+// the shards write into the ring one batch at a time
+static spinlock_t ring_lock;
 // update macro
 #define STILL_RUNNING 	0
 // list length cooperate macro
@@ -102,139 +209,1095 @@ static int wq_status = WQ_STOP;
 // character device macros & globals
 #define DEVICE_NAME 	"mp3_device"
 static int mp3_major_num = 0;
+// readers sleep here until wake_threshold samples are ready or a measurement period ends
+#define DEFAULT_WAKE_THRESHOLD 20 // 1s of samples at the default interval
+static unsigned wake_threshold = DEFAULT_WAKE_THRESHOLD;
+static DECLARE_WAIT_QUEUE_HEAD(mp3_read_wq);
+// read() is a ring consumer, one at a time
+static DEFINE_MUTEX(mp3_read_mutex);
+
+
+/*
+
+	Sample Ring
+
+*/
+// the record at a free running index, capacity is a power of two so the slots stay in order across the u32 wrap
+void* _ring_slot(u32 index){
+	return buf_ring + (index & (buf_header->capacity - 1)) * buf_header->record_size;
+}
+
+// the slot for the next record, or NULL & counted as dropped if the consumer left no room,
+// ring_lock held (one producer at a time)
+void* _ring_reserve(void){
+	u32 head;
+
+	head = buf_header->head;
+	if(head - smp_load_acquire(&buf_header->tail) >= buf_header->capacity){
+		buf_header->dropped += 1;
+		return NULL;
+	}
+	return _ring_slot(head);
+}
+
+// publish the reserved record, ring_lock held
+void _ring_commit(void){
+	u32 head;
+
+	head = buf_header->head + 1;
+	// the record is complete before the consumer can see the new head
+	smp_store_release(&buf_header->head, head);
+
+	if(head - READ_ONCE(buf_header->tail) >= wake_threshold){
+		wake_up_interruptible(&mp3_read_wq);
+	}
+}
+
+// append one aggregate sample
+void _ring_push(u64 timestamp_ns, unsigned long min_flt, unsigned long maj_flt, unsigned long cpu_time,
+	u32 missed, u32 late_us){
+	mp3_sample *slot;
+
+	slot = _ring_reserve();
+	if(slot == NULL){
+		return;
+	}
+
+	slot->jiffies = jiffies;
+	slot->timestamp_ns = timestamp_ns;
+	slot->min_flt = min_flt;
+	slot->maj_flt = maj_flt;
+	slot->cpu_time = cpu_time;
+	slot->missed = missed;
+	slot->late_us = late_us;
+
+	_ring_commit();
+}
+
+void _enc_push_event(u32 event, int pid, unsigned long maj_rate, unsigned cpu_pct);
+
+// append a load control event, see MP3_EVENT_* in mp3_buf.h, ring_lock held
+void _ring_push_event(u64 timestamp_ns, u32 event, int pid, unsigned long maj_rate, unsigned cpu_pct){
+	mp3_sample *sample;
+	mp3_proc_sample *proc;
+
+	if(buf_header->mode == MP3_MODE_ENCODED){
+		_enc_push_event(event, pid, maj_rate, cpu_pct);
+		return;
+	}
+
+	if(buf_header->mode == MP3_MODE_PROCESS){
+		proc = _ring_reserve();
+		if(proc == NULL){
+			return;
+		}
+		memset(proc, 0, sizeof(mp3_proc_sample));
+		proc->time_ms = (u32) div_u64(timestamp_ns, NSEC_PER_MSEC);
+		proc->maj_flt = event;
+		proc->min_flt = pid;
+		proc->wss_pages = min_t(unsigned long, maj_rate, U32_MAX);
+		proc->cpu_time = cpu_pct;
+	}else{
+		sample = _ring_reserve();
+		if(sample == NULL){
+			return;
+		}
+		memset(sample, 0, sizeof(mp3_sample));
+		sample->jiffies = MP3_EVENT_MARK;
+		sample->timestamp_ns = timestamp_ns;
+		sample->missed = event;
+		sample->min_flt = pid;
+		sample->maj_flt = maj_rate;
+		sample->cpu_time = cpu_pct;
+	}
+	_ring_commit();
+}
+
+// append len bytes as consecutive records of an encoded ring, all or nothing, ring_lock held
+bool _ring_write_bytes(const u8 *bytes, u32 len){
+	u32 head;
+	u32 index;
+	u32 first;
+
+	head = buf_header->head;
+	if(buf_header->capacity - (head - smp_load_acquire(&buf_header->tail)) < len){
+		buf_header->dropped += 1;
+		return false;
+	}
+
+	// the ring may wrap in the middle of the record
+	index = head & (buf_header->capacity - 1);
+	first = min(len, buf_header->capacity - index);
+	memcpy(buf_ring + index, bytes, first);
+	memcpy(buf_ring, bytes + first, len - first);
+
+	head += len;
+	// the record is complete before the consumer can see the new head
+	smp_store_release(&buf_header->head, head);
+
+	if(head - READ_ONCE(buf_header->tail) >= wake_threshold){
+		wake_up_interruptible(&mp3_read_wq);
+	}
+	return true;
+}
+
+// append the staged per-process records of a shard, ring_lock held
+void _ring_push_stage(mp3_proc_sample *stage, unsigned staged){
+	mp3_proc_sample *slot;
+	unsigned i;
+
+	for(i = 0; i < staged; i++){
+		slot = _ring_reserve();
+		if(slot == NULL){
+			// the rest is dropped too
+			buf_header->dropped += staged - i - 1;
+			return;
+		}
+		*slot = stage[i];
+		_ring_commit();
+	}
+}
+
+// a measurement period starts (running) or ends (!running), seq is odd while one is running, list_lock held
+void _ring_mark_period(bool running){
+	u32 seq;
+
+	seq = buf_header->seq;
+	// the end can be reported twice when the last process leaves while the work is running
+	if(((seq & 1) != 0) != running){
+		smp_store_release(&buf_header->seq, seq + 1);
+
+		// the samples left below the threshold are ready too
+		if(!running){
+			wake_up_interruptible(&mp3_read_wq);
+		}
+	}
+}
+
+/*
+	Rollups, see MP3_ROLLUP_* in mp3_buf.h: every round adds its sums to the current window of each level,
+	called by the merge of a round only, so one writer at a time
+*/
+void _rollup_init(void){
+	static const u32 resolutions[MP3_ROLLUP_LEVELS] = MP3_ROLLUP_RES_MS;
+	int level;
+
+	BUILD_BUG_ON(MP3_BUF_ROLLUP_OFFSET + MP3_ROLLUP_LEVELS * sizeof(mp3_rollup) > MP3_BUF_DATA_OFFSET);
+
+	for(level = 0; level < MP3_ROLLUP_LEVELS; level++){
+		buf_rollups[level].resolution_ms = resolutions[level];
+		buf_rollups[level].head = 0;
+	}
+}
+
+void _rollup_add(u64 timestamp_ns, unsigned long min_flt, unsigned long maj_flt, unsigned long cpu_time){
+	mp3_rollup *rollup;
+	mp3_rollup_slot *slot;
+	u64 values[MP3_ROLLUP_COUNTERS];
+	u64 window_ns;
+	u64 remainder_ns;
+	bool new_window;
+	int level;
+	int i;
+
+	values[MP3_ROLLUP_MIN_FLT] = min_flt;
+	values[MP3_ROLLUP_MAJ_FLT] = maj_flt;
+	values[MP3_ROLLUP_CPU_TIME] = cpu_time;
+
+	for(level = 0; level < MP3_ROLLUP_LEVELS; level++){
+		rollup = &buf_rollups[level];
+
+		// the start of the window of this sample
+		div64_u64_rem(timestamp_ns, (u64) rollup->resolution_ms * NSEC_PER_MSEC, &remainder_ns);
+		window_ns = timestamp_ns - remainder_ns;
+
+		slot = &rollup->slots[rollup->head % MP3_ROLLUP_SLOTS];
+		new_window = slot->count != 0 && slot->start_ns != window_ns;
+		if(new_window){
+			// the window is complete, the next slot takes the oldest one's place
+			slot = &rollup->slots[(rollup->head + 1) % MP3_ROLLUP_SLOTS];
+		}
+
+		WRITE_ONCE(slot->seq, slot->seq + 1);
+		smp_wmb();
+
+		if(new_window || slot->count == 0){
+			slot->start_ns = window_ns;
+			slot->count = 0;
+			memset(slot->sum, 0, sizeof(slot->sum));
+			memset(slot->max, 0, sizeof(slot->max));
+		}
+		// only once the slot is odd & reset: a reader that follows head never copies the old window
+		if(new_window){
+			smp_store_release(&rollup->head, rollup->head + 1);
+		}
+		for(i = 0; i < MP3_ROLLUP_COUNTERS; i++){
+			slot->sum[i] += values[i];
+			slot->max[i] = max(slot->max[i], values[i]);
+		}
+		slot->count += 1;
+
+		smp_wmb();
+		WRITE_ONCE(slot->seq, slot->seq + 1);
+	}
+}
+
+// init the header page, nothing in the ring
+void _ring_init(void){
+	memset(virtual_mem_buf, 0, buf_pages * VM_PAGE_SIZE);
+
+	buf_header = (mp3_buf_header*) virtual_mem_buf;
+	buf_ring = virtual_mem_buf + MP3_BUF_DATA_OFFSET;
+	buf_rollups = (mp3_rollup*) (virtual_mem_buf + MP3_BUF_ROLLUP_OFFSET);
+
+	buf_header->magic = MP3_BUF_MAGIC;
+	buf_header->version = MP3_BUF_VERSION;
+	if(!per_process && wss_window != 0){
+		printk(KERN_ALERT "wss_window: only with per_process, ignored\n");
+		wss_window = 0;
+	}
+
+	if(per_process){
+		buf_header->record_size = sizeof(mp3_proc_sample);
+		buf_header->mode = MP3_MODE_PROCESS;
+	}else if(encoded){
+		buf_header->record_size = 1;
+		buf_header->mode = MP3_MODE_ENCODED;
+	}else{
+		buf_header->record_size = sizeof(mp3_sample);
+		buf_header->mode = MP3_MODE_AGGREGATE;
+	}
+	// the free running indexes are masked, the records past the largest power of two stay unused
+	buf_header->capacity = rounddown_pow_of_two((buf_pages * VM_PAGE_SIZE - MP3_BUF_DATA_OFFSET) / buf_header->record_size);
+	buf_header->head = 0;
+	buf_header->tail = 0;
+	buf_header->seq = 0;
+	buf_header->dropped = 0;
+	buf_header->pages = buf_pages;
+
+	_rollup_init();
+}
+
+
+/*
+
+	Encoded Samples
+
+*/
+// the last record as the decoder sees it, the pending run of idle rows & whether the next row must be a key,
+// ring_lock held for all of them
+static u64 enc_prev_ns = 0;
+static u64 enc_prev_jiffies = 0;
+static u32 enc_interval_us = 0;
+static bool enc_need_key = true;
+static u32 enc_run = 0;
+static u64 enc_run_ns = 0;
+static u64 enc_run_jiffies = 0;
+
+// unsigned LEB128, return the bytes written
+unsigned _enc_varint(u8 *out, u64 value){
+	unsigned len;
+
+	len = 0;
+	while(value >= 0x80){
+		out[len++] = (u8) (value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (u8) value;
+	return len;
+}
+
+u64 _enc_zigzag(s64 value){
+	return ((u64) value << 1) ^ (u64) (value >> 63);
+}
+
+// the delta to ns rounded down to whole us, and move the previous timestamp the same way the decoder does
+s64 _enc_delta_us(u64 timestamp_ns){
+	u64 delta_us;
+
+	delta_us = div_u64(timestamp_ns - enc_prev_ns, NSEC_PER_USEC);
+	enc_prev_ns += delta_us * NSEC_PER_USEC;
+	return delta_us;
+}
+
+// write the pending run of idle rows, if any
+void _enc_flush_run(void){
+	u8 record[MP3_ENC_MAX_RECORD];
+	unsigned len;
+	s64 delta_us;
+
+	if(enc_run == 0){
+		return;
+	}
+
+	delta_us = _enc_delta_us(enc_run_ns);
+
+	len = _enc_varint(record, ((u64) enc_run << MP3_ENC_TYPE_BITS) | MP3_ENC_RUN);
+	len += _enc_varint(record + len, _enc_zigzag(delta_us - (s64) enc_run * enc_interval_us));
+	len += _enc_varint(record + len, enc_run_jiffies - enc_prev_jiffies);
+	enc_prev_jiffies = enc_run_jiffies;
+	enc_run = 0;
+
+	if(!_ring_write_bytes(record, len)){
+		enc_need_key = true;
+	}
+}
+
+// append one aggregate sample in the encoded form, ring_lock held
+void _enc_push(u64 timestamp_ns, unsigned long min_flt, unsigned long maj_flt, unsigned long cpu_time,
+	u32 missed, u32 late_us){
+	u8 record[MP3_ENC_MAX_RECORD];
+	unsigned len;
+	u32 interval_us;
+	s64 delta_us;
+
+	interval_us = READ_ONCE(sample_interval) * USEC_PER_MSEC;
+
+	// idle rows wait for the end of their run
+	if(!enc_need_key && interval_us == enc_interval_us && min_flt == 0 && maj_flt == 0
+		&& cpu_time == 0 && missed == 0){
+		enc_run += 1;
+		enc_run_ns = timestamp_ns;
+		enc_run_jiffies = jiffies;
+		if(enc_run == MP3_ENC_MAX_RUN){
+			_enc_flush_run();
+		}
+		return;
+	}
+	_enc_flush_run();
+
+	if(enc_need_key || interval_us != enc_interval_us){
+		len = _enc_varint(record, ((u64) interval_us << MP3_ENC_TYPE_BITS) | MP3_ENC_KEY);
+		len += _enc_varint(record + len, timestamp_ns);
+		len += _enc_varint(record + len, jiffies);
+		enc_interval_us = interval_us;
+		enc_prev_ns = timestamp_ns;
+	}else{
+		delta_us = _enc_delta_us(timestamp_ns);
+		len = _enc_varint(record, (_enc_zigzag(delta_us - interval_us) << MP3_ENC_TYPE_BITS) | MP3_ENC_ROW);
+		len += _enc_varint(record + len, jiffies - enc_prev_jiffies);
+	}
+	enc_prev_jiffies = jiffies;
+
+	len += _enc_varint(record + len, min_flt);
+	len += _enc_varint(record + len, maj_flt);
+	len += _enc_varint(record + len, cpu_time);
+	len += _enc_varint(record + len, missed);
+	len += _enc_varint(record + len, late_us);
+
+	// the decoder lost its reference with a dropped record
+	enc_need_key = !_ring_write_bytes(record, len);
+}
+
+// append a load control event after the current record: the pending run goes first, the event does not move
+// the reference of the deltas, ring_lock held
+void _enc_push_event(u32 event, int pid, unsigned long maj_rate, unsigned cpu_pct){
+	u8 record[MP3_ENC_MAX_RECORD];
+	unsigned len;
+
+	_enc_flush_run();
+
+	len = _enc_varint(record, ((u64) event << MP3_ENC_TYPE_BITS) | MP3_ENC_EVENT);
+	len += _enc_varint(record + len, pid);
+	len += _enc_varint(record + len, maj_rate);
+	len += _enc_varint(record + len, cpu_pct);
+
+	if(!_ring_write_bytes(record, len)){
+		enc_need_key = true;
+	}
+}
+
+// the end of a measurement period: write the pending run, the next period starts with a key, ring_lock held
+void _enc_end_period(void){
+	_enc_flush_run();
+	enc_need_key = true;
+}
+
+
+/*
+
+	Working Set Scan
+
+*/
+// test & clear the accessed bits of the ptes in [addr, end) of one pmd, count the young ones.
+// Return the ptes looked at
+unsigned long _wss_scan_ptes(struct vm_area_struct *vma, pmd_t *pmd, unsigned long addr, unsigned long end, unsigned long *young){
+	spinlock_t *ptl;
+	pte_t *pte;
+	pte_t *start_pte;
+	unsigned long scanned;
+
+	scanned = 0;
+	start_pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for(pte = start_pte; addr < end; pte++, addr += PAGE_SIZE){
+		scanned += 1;
+		if(pte_present(*pte) && ptep_test_and_clear_young(vma, addr, pte)){
+			*young += 1;
+		}
+	}
+	pte_unmap_unlock(start_pte, ptl);
+
+	return scanned;
+}
+
+// scan [addr, vma end) until the budget runs out: the page tables level by level, a huge pmd is one entry
+// for HPAGE_PMD_NR pages. Return where to go on next time
+unsigned long _wss_scan_vma(struct vm_area_struct *vma, unsigned long addr, unsigned long *budget, unsigned long *young){
+	struct mm_struct *mm;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	spinlock_t *ptl;
+	unsigned long next;
+	unsigned long scanned;
+
+	mm = vma->vm_mm;
+	while(addr < vma->vm_end && *budget > 0){
+		next = pmd_addr_end(addr, vma->vm_end);
+		// at most the budget, the pass goes on from there
+		next = min(next, addr + *budget * PAGE_SIZE);
+
+		pgd = pgd_offset(mm, addr);
+		if(pgd_none_or_clear_bad(pgd)){
+			addr = pgd_addr_end(addr, vma->vm_end);
+			*budget -= 1;
+			continue;
+		}
+		pud = pud_offset(pgd, addr);
+		if(pud_none_or_clear_bad(pud)){
+			addr = pud_addr_end(addr, vma->vm_end);
+			*budget -= 1;
+			continue;
+		}
+		pmd = pmd_offset(pud, addr);
+
+		if(pmd_trans_huge(*pmd)){
+			ptl = pmd_lock(mm, pmd);
+			if(pmd_trans_huge(*pmd) && pmdp_test_and_clear_young(vma, addr, pmd)){
+				*young += HPAGE_PMD_NR;
+			}
+			spin_unlock(ptl);
+			addr = pmd_addr_end(addr, vma->vm_end);
+			*budget -= 1;
+			continue;
+		}
+		if(pmd_none_or_trans_huge_or_clear_bad(pmd)){
+			addr = pmd_addr_end(addr, vma->vm_end);
+			*budget -= 1;
+			continue;
+		}
+
+		scanned = _wss_scan_ptes(vma, pmd, addr, next, young);
+		*budget -= min(scanned, *budget);
+		addr = next;
+	}
+
+	return addr;
+}
+
+// go on with the pass of one entry until the budget runs out, or start one if the window is over.
+// Called under rcu_read_lock(): task_lock() keeps the address space of the task alive instead of
+// a reference that may need to sleep to drop, and mmap_sem is only tried, the next round tries again
+void _wss_scan_entry(mp3_list_entry *entry, unsigned long *budget, ktime_t now){
+	struct task_struct *task;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	unsigned long young;
+	unsigned long old_pages;
+
+	if(entry->wss_addr == 0){
+		if(entry->wss_passes != 0 && ktime_to_ms(ktime_sub(now, entry->wss_pass_start)) < wss_window){
+			return;
+		}
+		// a new pass
+		entry->wss_addr = 1;
+		entry->wss_young = 0;
+		entry->wss_pass_start = now;
+	}
+
+	task = entry->pcb_ptr;
+	task_lock(task);
+	mm = task->mm;
+	if(mm == NULL || !down_read_trylock(&mm->mmap_sem)){
+		task_unlock(task);
+		return;
+	}
+
+	addr = entry->wss_addr;
+	young = 0;
+	vma = find_vma(mm, addr);
+	while(vma != NULL && *budget > 0){
+		addr = _wss_scan_vma(vma, max(addr, vma->vm_start), budget, &young);
+		if(addr >= vma->vm_end){
+			vma = vma->vm_next;
+		}
+	}
+	// the cleared bits may still be cached in a tlb, the next touch would not set them again
+	if(young != 0){
+		flush_tlb_mm(mm);
+	}
+
+	up_read(&mm->mmap_sem);
+	task_unlock(task);
+
+	entry->wss_young += young;
+	if(vma != NULL){
+		entry->wss_addr = addr;
+		return;
+	}
+
+	// the pass is over. The first one only cleared the bits, it counted every page touched since the start
+	entry->wss_addr = 0;
+	entry->wss_passes += 1;
+	if(entry->wss_passes > 1){
+		old_pages = entry->wss_pages;
+		entry->wss_pages = entry->wss_young;
+		entry->wss_delta = (long) entry->wss_pages - (long) old_pages;
+	}
+}
+
+// the turn of the entry at position pos of its shard in this round's scan. The entries share one budget,
+// the one it runs out on goes first next round, so the shard never scans more than wss_budget ptes a round
+void _wss_turn(mp3_shard *shard, mp3_list_entry *entry, unsigned pos, unsigned long *budget){
+	if(*budget == 0){
+		return;
+	}
+	_wss_scan_entry(entry, budget, round_start);
+	if(*budget == 0){
+		shard->wss_next = pos;
+	}
+}
+
+
+/*
+
+	Load Control
+
+*/
+// the rounds in a row over the thresholds / well under them, the processes stopped & the order of the last one,
+// list_lock held for all of them
+static unsigned thrash_rounds = 0;
+static unsigned calm_rounds = 0;
+static unsigned suspended_count = 0;
+static unsigned suspend_order = 0;
+
+bool _entry_exited(mp3_list_entry *entry);
+
+// the lowest priority process still running: the highest nice value, then the highest pid, the newest
+// most of the time. NULL if it is the last one running, stopping it would not relieve anything
+mp3_list_entry* _pick_suspend(void){
+	mp3_list_entry *this_entry;
+	mp3_list_entry *victim;
+	unsigned running;
+	unsigned i;
+
+	victim = NULL;
+	running = 0;
+	for(i = 0; i < shard_count; i++){
+		list_for_each_entry(this_entry, &shards[i].list, head){
+			if(this_entry->suspended != 0 || _entry_exited(this_entry)){
+				continue;
+			}
+			running += 1;
+
+			if(victim == NULL || task_nice(this_entry->pcb_ptr) > task_nice(victim->pcb_ptr)
+				|| (task_nice(this_entry->pcb_ptr) == task_nice(victim->pcb_ptr) && this_entry->pid > victim->pid)){
+				victim = this_entry;
+			}
+		}
+	}
+
+	if(running < 2){
+		return NULL;
+	}
+	return victim;
+}
+
+// the process stopped last, the highest priority one of those stopped
+mp3_list_entry* _pick_resume(void){
+	mp3_list_entry *this_entry;
+	mp3_list_entry *last;
+	unsigned i;
+
+	last = NULL;
+	for(i = 0; i < shard_count; i++){
+		list_for_each_entry(this_entry, &shards[i].list, head){
+			if(this_entry->suspended != 0 && (last == NULL || this_entry->suspended > last->suspended)){
+				last = this_entry;
+			}
+		}
+	}
+	return last;
+}
+
+// SIGCONT a stopped process, list_lock held
+void _resume_entry(mp3_list_entry *entry){
+	send_sig(SIGCONT, entry->pcb_ptr, 1);
+	entry->suspended = 0;
+	suspended_count -= 1;
+}
+
+// the cpus the registered processes could have kept busy: one per process not stopped, online ones at most,
+// at least 1. Their cpu time is that of one thread each, list_lock held
+unsigned _usable_cpus(void){
+	mp3_list_entry *this_entry;
+	unsigned running;
+	unsigned i;
+
+	running = 0;
+	for(i = 0; i < shard_count; i++){
+		list_for_each_entry(this_entry, &shards[i].list, head){
+			if(this_entry->suspended == 0 && !_entry_exited(this_entry)){
+				running += 1;
+			}
+		}
+	}
+	return clamp(running, 1u, num_online_cpus());
+}
+
+// thrashing: many major faults & little cpu time, the processes wait for the disk instead of running.
+// After thrash_hold such rounds in a row, stop the lowest priority process; after thrash_hold rounds with
+// less than half the fault rate, resume the last one stopped. The decisions go to the ring, list_lock held
+void _load_control(u64 timestamp_ns, unsigned long maj_flt, unsigned long cpu_time, u32 missed){
+	mp3_list_entry *entry;
+	unsigned long elapsed_us;
+	unsigned long maj_rate;
+	unsigned cpu_pct;
+	u32 event;
+
+	// the round covers the missed deadlines too
+	elapsed_us = (missed + 1) * READ_ONCE(sample_interval) * USEC_PER_MSEC;
+	maj_rate = maj_flt * USEC_PER_SEC / elapsed_us;
+	// of what they could use, not of the machine: 2 processes at full speed on 8 cpus are not thrashing
+	cpu_pct = min_t(u64, div_u64((u64) cputime_to_usecs(cpu_time) * 100, (u64) elapsed_us * _usable_cpus()), 100);
+
+	entry = NULL;
+	event = 0;
+	if(maj_rate >= thrash_maj_rate && cpu_pct <= thrash_cpu){
+		calm_rounds = 0;
+		thrash_rounds += 1;
+		if(thrash_rounds >= thrash_hold){
+			thrash_rounds = 0;
+			entry = _pick_suspend();
+			if(entry != NULL){
+				send_sig(SIGSTOP, entry->pcb_ptr, 1);
+				suspend_order += 1;
+				entry->suspended = suspend_order;
+				suspended_count += 1;
+				event = MP3_EVENT_SUSPEND;
+			}
+		}
+	}else if(maj_rate < thrash_maj_rate / 2){
+		thrash_rounds = 0;
+		if(suspended_count > 0){
+			calm_rounds += 1;
+		}
+		if(calm_rounds >= thrash_hold){
+			calm_rounds = 0;
+			entry = _pick_resume();
+			if(entry != NULL){
+				_resume_entry(entry);
+				event = MP3_EVENT_RESUME;
+			}
+		}
+	}else{
+		// in between: nothing changes, neither count goes on
+		thrash_rounds = 0;
+		calm_rounds = 0;
+	}
+
+	if(event == 0){
+		return;
+	}
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "load control [%u] pid:[%d] maj/s:[%lu] cpu:[%u%%]\n", event, entry->pid, maj_rate, cpu_pct);
+	#endif
+
+	spin_lock(&ring_lock);
+	_ring_push_event(timestamp_ns, event, entry->pid, maj_rate, cpu_pct);
+	spin_unlock(&ring_lock);
+}
 
 
 /*
 
-	Delayed Work Queue
+	Work Queue & Sampling Timer
 
 */
-void _queue_work(void);
 void _report_terminate(void);
-// collect the status information in buffer, linked list traversal
-void update_virtual_mem_buf(struct work_struct *data){
-   	struct list_head *pos;
-   	struct list_head *temp;
+// the task of the entry has exited, or has been reaped already
+bool _entry_exited(mp3_list_entry *entry){
+	return entry->pcb_ptr->exit_state != 0;
+}
 
-   	mp3_list_entry *this_entry;
-   	unsigned long this_utime;
-   	unsigned long this_stime;
-   	unsigned long this_maj_flt;
-   	unsigned long this_min_flt;
+// the fault & cpu counters since the last sample of this entry, then move its baselines forward.
+// Unlike get_cpu_use(), the task_struct is left as is for ps, top & other profilers, and it is
+// read through the reference of the entry instead of a pid lookup. Return STILL_RUNNING or -1
+int _sample_entry(mp3_list_entry *entry, unsigned long *min_flt, unsigned long *maj_flt, unsigned long *cpu_time){
+	struct task_struct *task;
+	unsigned long this_min_flt;
+	unsigned long this_maj_flt;
+	unsigned long this_cpu_time;
+
+	task = entry->pcb_ptr;
+	if(_entry_exited(entry)){
+		return -1;
+	}
 
-   	unsigned long acc_cpu_util;
-   	unsigned long acc_maj_flt;
-   	unsigned long acc_min_flt;
+	this_min_flt = READ_ONCE(task->min_flt);
+	this_maj_flt = READ_ONCE(task->maj_flt);
+	this_cpu_time = READ_ONCE(task->utime) + READ_ONCE(task->stime);
 
-   	#ifdef DEBUG
-   	printk(KERN_ALERT "update_virtual_mem_buf called\n");
-   	#endif
+	*min_flt = this_min_flt - entry->minor_fault_count;
+	*maj_flt = this_maj_flt - entry->major_fault_count;
+	*cpu_time = this_cpu_time - entry->cpu_util;
 
-   	acc_cpu_util = 0;
-   	acc_maj_flt = 0;
-   	acc_min_flt = 0;
+	entry->minor_fault_count = this_min_flt;
+	entry->major_fault_count = this_maj_flt;
+	entry->cpu_util = this_cpu_time;
 
-   	spin_lock(&list_lock);
-	  
-   	// safe traversal with memory freed
-   	list_for_each_safe(pos, temp, list_head_ptr(regist_head) ){
-		this_entry = (mp3_list_entry*) pos;
+	return STILL_RUNNING;
+}
 
-		// running or not
-		if(get_cpu_use(this_entry->pid, &this_min_flt,
-			&this_maj_flt, &this_utime, &this_stime) == STILL_RUNNING){
-			acc_cpu_util += (this_utime + this_stime);
-			acc_maj_flt += this_maj_flt;
-			acc_min_flt += this_min_flt;
-		}else{
-			// remove from the linked list
-			list_del(pos);
+// the baselines of a newly registered entry: the current counters
+void _init_entry_baselines(mp3_list_entry *entry){
+	entry->minor_fault_count = entry->pcb_ptr->min_flt;
+	entry->major_fault_count = entry->pcb_ptr->maj_flt;
+	entry->cpu_util = entry->pcb_ptr->utime + entry->pcb_ptr->stime;
 
-			#ifdef DEBUG
-			printk(KERN_ALERT "free [%p]\n", this_entry);
-			#endif
+	entry->wss_addr = 0;
+	entry->wss_young = 0;
+	entry->wss_pass_start = ktime_set(0, 0);
+	entry->wss_passes = 0;
+	entry->wss_pages = 0;
+	entry->wss_delta = 0;
 
-			kmem_cache_free(mp3_entry_slab, this_entry);
-			mp3_list_length -= 1;
+	entry->suspended = 0;
+}
+
+// drop the task reference & free the entry once no sampler can see it anymore
+void _free_entry_rcu(struct rcu_head *rcu){
+	mp3_list_entry *entry;
+
+	entry = container_of(rcu, mp3_list_entry, rcu);
+	put_task_struct(entry->pcb_ptr);
+	kmem_cache_free(mp3_entry_slab, entry);
+}
+
+// remove an entry from its shard, list_lock held
+void _remove_entry(mp3_shard *shard, mp3_list_entry *entry){
+	list_del_rcu(list_head_ptr(entry));
+
+	// never leave a process stopped behind
+	if(entry->suspended != 0){
+		_resume_entry(entry);
+	}
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "free [%p]\n", entry);
+	#endif
+
+	call_rcu(&entry->rcu, _free_entry_rcu);
+	shard->length -= 1;
+	mp3_list_length -= 1;
+}
+
+// the shard of a pid
+mp3_shard* _pid_shard(int pid){
+	return &shards[(unsigned) pid % shard_count];
+}
+
+// copy the staged records of the shard to the ring
+void _flush_stage(mp3_shard *shard){
+	if(shard->staged == 0){
+		return;
+	}
+
+	spin_lock(&ring_lock);
+	_ring_push_stage(shard->stage, shard->staged);
+	spin_unlock(&ring_lock);
+
+	shard->staged = 0;
+}
+
+// stage the per-process record of one entry, the counters saturate. All the records of a round carry
+// the start of the round, and a round only starts once the previous one is merged, so the stream is in time order
+void _stage_proc(mp3_shard *shard, mp3_list_entry *entry, unsigned long min_flt, unsigned long maj_flt, unsigned long cpu_time){
+	mp3_proc_sample *record;
+
+	if(shard->staged == SHARD_STAGE_RECORDS){
+		_flush_stage(shard);
+	}
+
+	record = &shard->stage[shard->staged];
+	record->time_ms = (u32) div_u64(ktime_to_ns(round_start), NSEC_PER_MSEC);
+	record->pid = entry->pid;
+	record->min_flt = min_t(unsigned long, min_flt, U32_MAX);
+	record->maj_flt = min_t(unsigned long, maj_flt, U16_MAX);
+	record->cpu_time = min_t(unsigned long, cpu_time, U16_MAX);
+	record->wss_pages = min_t(unsigned long, entry->wss_pages, U32_MAX);
+	record->wss_delta = clamp_t(long, entry->wss_delta, S32_MIN, S32_MAX);
+
+	shard->staged += 1;
+}
+
+// the last shard of a round merges it: sums the shards into the aggregate record, removes the exited tasks
+// & decides whether sampling goes on. Only the short update here takes list_lock
+void _merge_round(void){
+	struct list_head *pos;
+	struct list_head *temp;
+	mp3_list_entry *this_entry;
+	mp3_shard *shard;
+
+	unsigned long acc_cpu_util;
+	unsigned long acc_maj_flt;
+	unsigned long acc_min_flt;
+	s64 late_us;
+	unsigned i;
+
+	acc_cpu_util = 0;
+	acc_maj_flt = 0;
+	acc_min_flt = 0;
+
+	spin_lock(&list_lock);
+
+	for(i = 0; i < shard_count; i++){
+		shard = &shards[i];
+
+		acc_cpu_util += shard->acc_cpu_util;
+		acc_maj_flt += shard->acc_maj_flt;
+		acc_min_flt += shard->acc_min_flt;
+
+		// remove the exited tasks from the linked list
+		if(shard->exited){
+			list_for_each_safe(pos, temp, &shard->list){
+				this_entry = (mp3_list_entry*) pos;
+				if(_entry_exited(this_entry)){
+					_remove_entry(shard, this_entry);
+				}
+			}
 		}
-   	}
+	}
 
-   	// whether to report or not : sth left running
-   	if(mp3_list_length > 0 && sampling_count < MAX_SAMPLE_ALLOWED){
-   		// report
-   		sampling_position_ptr[0] = jiffies;
-   		sampling_position_ptr[1] = acc_min_flt;
-   		sampling_position_ptr[2] = acc_maj_flt;
-   		sampling_position_ptr[3] = acc_cpu_util;
-
-   		#ifdef DEBUG
-   		printk(KERN_ALERT "report [%lu] min_flt:[%lu] maj_flt:[%lu] cpu:[%lu]\n", jiffies, acc_min_flt, acc_maj_flt, acc_cpu_util);
-   		#endif
-
-   		sampling_count += 1;
-   		sampling_position_ptr += 4;
-   	}else{
-   		// stop reporting
-   		wq_status = WQ_STOP;
-   	}
+	// whether to report or not : sth left running, the ring never fills up for good
+	if(mp3_list_length > 0){
+		// report, the per-process records are already in
+		if(!per_process){
+			late_us = ktime_us_delta(round_start, round_deadline);
+			if(late_us < 0){
+				late_us = 0;
+			}
+
+			spin_lock(&ring_lock);
+			if(buf_header->mode == MP3_MODE_ENCODED){
+				_enc_push(ktime_to_ns(round_start), acc_min_flt, acc_maj_flt, acc_cpu_util, round_missed, late_us);
+			}else{
+				_ring_push(ktime_to_ns(round_start), acc_min_flt, acc_maj_flt, acc_cpu_util, round_missed, late_us);
+			}
+			spin_unlock(&ring_lock);
+		}
+
+		_rollup_add(ktime_to_ns(round_start), acc_min_flt, acc_maj_flt, acc_cpu_util);
+
+		if(load_control){
+			_load_control(ktime_to_ns(round_start), acc_maj_flt, acc_cpu_util, round_missed);
+		}
 
-   	spin_unlock(&list_lock);
-   	
-   	// keep queuing if no status change
-   	if(wq_status == WQ_QUEUE){
-   		_queue_work();
+		#ifdef DEBUG
+		printk(KERN_ALERT "report [%lu] min_flt:[%lu] maj_flt:[%lu] cpu:[%lu]\n", jiffies, acc_min_flt, acc_maj_flt, acc_cpu_util);
+		#endif
 	}else{
+		// stop reporting
+		wq_status = WQ_STOP;
+	}
+
+	spin_unlock(&list_lock);
+
+	// the timer keeps queuing if no status change
+	if(wq_status == WQ_STOP){
 		_report_terminate();
 	}
 }
 
-// init the delayed work queue, reuse the delayed_work struct
+// collect the status information of one shard, on its cpu, linked list traversal.
+// Registering & unregistering never wait for the traversal, only for the short merge at the end
+void update_virtual_mem_buf(struct work_struct *data){
+	mp3_shard *shard;
+	mp3_list_entry *this_entry;
+	unsigned long this_cpu_time;
+	unsigned long this_maj_flt;
+	unsigned long this_min_flt;
+	unsigned long wss_left;
+	unsigned wss_start;
+	unsigned pos;
+
+	#ifdef DEBUG
+	printk(KERN_ALERT "update_virtual_mem_buf called\n");
+	#endif
+
+	shard = container_of(data, mp3_shard, work);
+	// the scan budget of the round, from the entry the last one stopped at on
+	wss_left = wss_budget;
+	wss_start = shard->wss_next;
+	shard->wss_next = 0;
+	pos = 0;
+
+	shard->acc_cpu_util = 0;
+	shard->acc_maj_flt = 0;
+	shard->acc_min_flt = 0;
+	shard->exited = false;
+
+	// the shard's work is the only one to touch its baselines & its stage
+	rcu_read_lock();
+	list_for_each_entry_rcu(this_entry, &shard->list, head){
+		// running or not
+		if(_sample_entry(this_entry, &this_min_flt,
+			&this_maj_flt, &this_cpu_time) == STILL_RUNNING){
+			shard->acc_cpu_util += this_cpu_time;
+			shard->acc_maj_flt += this_maj_flt;
+			shard->acc_min_flt += this_min_flt;
+
+			if(wss_window != 0 && pos >= wss_start){
+				_wss_turn(shard, this_entry, pos, &wss_left);
+			}
+			if(per_process){
+				_stage_proc(shard, this_entry, this_min_flt, this_maj_flt, this_cpu_time);
+			}
+		}else{
+			shard->exited = true;
+		}
+		pos += 1;
+	}
+
+	// then the entries before the start, with what is left
+	if(wss_window != 0 && wss_start != 0 && wss_left != 0){
+		pos = 0;
+		list_for_each_entry_rcu(this_entry, &shard->list, head){
+			if(pos == wss_start){
+				break;
+			}
+			if(!_entry_exited(this_entry)){
+				_wss_turn(shard, this_entry, pos, &wss_left);
+			}
+			pos += 1;
+		}
+	}
+	rcu_read_unlock();
+
+	_flush_stage(shard);
+
+	// the shard's sums are visible to whoever merges the round
+	if(atomic_dec_and_test(&shards_pending)){
+		_merge_round();
+	}
+}
+
+// the sampling timer: start a round for this deadline on every shard, then move to the next deadline not passed yet
+enum hrtimer_restart _sample_timer_func(struct hrtimer *timer){
+	u64 overruns;
+	unsigned i;
+
+	// the last process left, the work does not come back
+	if(READ_ONCE(wq_status) == WQ_STOP){
+		return HRTIMER_NORESTART;
+	}
+
+	spin_lock(&sample_lock);
+
+	if(atomic_read(&shards_pending) != 0){
+		// the previous round is still running, this one is merged into the next one
+		sample_missed += 1;
+	}else{
+		round_deadline = hrtimer_get_expires(timer);
+		round_start = ktime_get();
+		round_missed = sample_missed;
+		sample_missed = 0;
+
+		atomic_set(&shards_pending, shard_count);
+		for(i = 0; i < shard_count; i++){
+			queue_work_on(shards[i].cpu, mp3_wq, &shards[i].work);
+		}
+	}
+
+	// more than one interval: the timer itself ran late, every deadline skipped is missed
+	overruns = hrtimer_forward_now(timer, ms_to_ktime(READ_ONCE(sample_interval)));
+	if(overruns > 1){
+		sample_missed += overruns - 1;
+	}
+
+	spin_unlock(&sample_lock);
+
+	return HRTIMER_RESTART;
+}
+
+// init the work queue & the sampling timer, the work structs are in the shards
 void _init_work_queue(void){
 	mp3_wq = create_workqueue("mp3_wq");
-	mp3_work_ptr = kmalloc(sizeof(struct delayed_work), GFP_KERNEL);
 	wq_status = WQ_STOP;
 
-	// init the work struct
-	INIT_DELAYED_WORK(mp3_work_ptr, update_virtual_mem_buf);
+	spin_lock_init(&ring_lock);
+	spin_lock_init(&sample_lock);
+	hrtimer_init(&sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	sample_timer.function = _sample_timer_func;
 }
 
-// queue work
+// start sampling: the first deadline is one interval from now
 void _queue_work(void){
+	unsigned long flags;
+
 	#ifdef DEBUG
 	printk(KERN_ALERT "_queue_work called\n");
 	#endif
 
-	queue_delayed_work(mp3_wq, mp3_work_ptr, msecs_to_jiffies(WQ_TIME_INTERVAL));
+	spin_lock_irqsave(&sample_lock, flags);
+	sample_missed = 0;
+	spin_unlock_irqrestore(&sample_lock, flags);
+
+	hrtimer_start(&sample_timer, ktime_add(ktime_get(), ms_to_ktime(sample_interval)), HRTIMER_MODE_ABS);
 }
 
-// stop queuing work by canceling the latest work
+// stop the timer, then let the round in progress finish, all of its shards or none
 void _stop_work(void){
+	unsigned i;
+
 	#ifdef DEBUG
 	printk(KERN_ALERT "_stop_work called\n");
 	#endif
 
-	cancel_delayed_work_sync(mp3_work_ptr);
-	// after cancellation synchronized, report termination
+	hrtimer_cancel(&sample_timer);
+	for(i = 0; i < shard_count; i++){
+		flush_work(&shards[i].work);
+	}
+	// after the flush synchronized, report termination
 	_report_terminate();
 }
 
 void _report_terminate(void){
-	// report a terminating mark
-	sampling_position_ptr[0] = -1;
-	sampling_position_ptr[1] = -1;
-	sampling_position_ptr[2] = -1;
-	sampling_position_ptr[3] = -1;
+	spin_lock(&list_lock);
+
+	// the end of the measurement period, instead of a row of -1 in the buffer,
+	// unless a new process got registered in the meantime
+	if(wq_status == WQ_STOP){
+		// the idle rows held back are part of the period
+		if(buf_header->mode == MP3_MODE_ENCODED){
+			spin_lock(&ring_lock);
+			_enc_end_period();
+			spin_unlock(&ring_lock);
+		}
+		_ring_mark_period(false);
+	}
 
-	sampling_count += 1;
-	sampling_position_ptr += 4;
+	spin_unlock(&list_lock);
 }
 
-// flush then destroy the work queue
+// stop the timer, flush then destroy the work queue
 void _destroy_work_queue(void){
 	wq_status = WQ_STOP;
+	hrtimer_cancel(&sample_timer);
 	flush_workqueue(mp3_wq);
    	destroy_workqueue(mp3_wq);
-   	kfree(mp3_work_ptr);
 }
 
 /*
@@ -245,24 +1308,40 @@ void _destroy_work_queue(void){
 // register a new process, linked list insert
 void register_process(int pid_int){
 	mp3_list_entry *new_entry;
+	mp3_shard *shard;
 	bool queue_work;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "insert [%d]\n", pid_int);
 	#endif
 
-	spin_lock(&list_lock);
-
-	// init the new entry
-	new_entry = kmem_cache_alloc(mp3_entry_slab, SLAB_PANIC);
+	// init the new entry, with a reference to the task so that it is never looked up again
+	new_entry = kmem_cache_alloc(mp3_entry_slab, GFP_KERNEL);
+	if(new_entry == NULL){
+		return;
+	}
 	new_entry->pid = pid_int;
+
+	rcu_read_lock();
 	new_entry->pcb_ptr = find_task_by_pid(new_entry->pid);
-	new_entry->cpu_util = 0;
-	new_entry->major_fault_count = 0;
-	new_entry->minor_fault_count = 0;
+	if(new_entry->pcb_ptr != NULL){
+		get_task_struct(new_entry->pcb_ptr);
+	}
+	rcu_read_unlock();
+
+	// no such process, nothing to sample
+	if(new_entry->pcb_ptr == NULL){
+		kmem_cache_free(mp3_entry_slab, new_entry);
+		return;
+	}
+	_init_entry_baselines(new_entry);
+	shard = _pid_shard(pid_int);
+
+	spin_lock(&list_lock);
 
-	// add this to the linked list
-	list_add(list_head_ptr(new_entry), list_head_ptr(regist_head));
+	// add this to the linked list of its shard, the entry is complete before the sampler can see it
+	list_add_rcu(list_head_ptr(new_entry), &shard->list);
+	shard->length += 1;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "inserted at [%p]\n", new_entry);
@@ -271,6 +1350,7 @@ void register_process(int pid_int){
 	if(mp3_list_length == 0 && wq_status == WQ_STOP){
 		queue_work = true;
 		wq_status = WQ_QUEUE;
+		_ring_mark_period(true);
 	}else{
 		queue_work = false;
 	}
@@ -289,6 +1369,7 @@ void unregister_process(int pid_int){
 	struct list_head *pos;
 	struct list_head *temp;
 	mp3_list_entry *this_entry;
+	mp3_shard *shard;
 
 	bool stop_work;
 
@@ -296,22 +1377,17 @@ void unregister_process(int pid_int){
 	printk(KERN_ALERT "unregister_process [%d]\n", pid_int);
 	#endif
 
+	shard = _pid_shard(pid_int);
+
 	spin_lock(&list_lock);
 
 	// safe traversal with memory freed
-	list_for_each_safe(pos, temp, list_head_ptr(regist_head)){
+	list_for_each_safe(pos, temp, &shard->list){
 		this_entry = (mp3_list_entry*) pos;
 
-		if(this_entry->pid == pid_int){;
-			// remove from  the linked list
-			list_del(pos);
-
-			#ifdef DEBUG
-			printk(KERN_ALERT "free [%p]\n", this_entry);
-			#endif
-
-			kmem_cache_free(mp3_entry_slab, this_entry);
-			mp3_list_length -= 1;
+		if(this_entry->pid == pid_int){
+			// remove from  the linked list, freed after the sampler is done with it
+			_remove_entry(shard, this_entry);
 			break;
 		}
 	}
@@ -338,38 +1414,39 @@ ssize_t read_all_registered(char *buf, size_t buf_len){
 	ssize_t total;
 	int printed_len;
 
-	struct list_head *pos;
 	mp3_list_entry *this_entry;
+	unsigned i;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "read_all_registered called\n");
 	#endif
 
-	spin_lock(&list_lock);
+	rcu_read_lock();
 
 	// for str formatting
 	temp = buf;
 	remain_len = buf_len;
 	total = 0;
 
-	// list traversal, it is a for loop
-	list_for_each(pos, list_head_ptr(regist_head)){
-		this_entry = (mp3_list_entry*) pos;
-
-		printed_len = snprintf(temp, remain_len, "%d\n", this_entry->pid);
-		
-		// update positions
-		total += printed_len;
-		temp += printed_len;
-		remain_len -= printed_len;
-
-		// defense against buffer overflow
-		if(remain_len <= 1){
-		 	break;
+	// list traversal, shard by shard
+	for(i = 0; i < shard_count && remain_len > 1; i++){
+		list_for_each_entry_rcu(this_entry, &shards[i].list, head){
+
+			printed_len = snprintf(temp, remain_len, "%d\n", this_entry->pid);
+			
+			// update positions
+			total += printed_len;
+			temp += printed_len;
+			remain_len -= printed_len;
+
+			// defense against buffer overflow
+			if(remain_len <= 1){
+			 	break;
+			}
 		}
 	}
 
-	spin_unlock(&list_lock);
+	rcu_read_unlock();
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "read_all_registered finished [%s]\n", buf);
@@ -378,64 +1455,593 @@ ssize_t read_all_registered(char *buf, size_t buf_len){
 	return total;
 }
 
-// init the linked list & the spin lock
+// init the shards, one per online cpu, & the spin lock
 void init_linked_list(void){
+	mp3_shard *shard;
+	int cpu;
+
 	#ifdef DEBUG
 	printk(KERN_ALERT "init_linked_list called\n");
 	#endif
 
 	spin_lock_init(&list_lock);
 
-	spin_lock(&list_lock);
+	// cpus going offline later keep their shard, its work then runs elsewhere
+	get_online_cpus();
+	shards = kcalloc(num_online_cpus(), sizeof(mp3_shard), GFP_KERNEL);
+	shard_count = 0;
+
+	for_each_online_cpu(cpu){
+		shard = &shards[shard_count];
+
+		INIT_LIST_HEAD(&shard->list);
+		shard->length = 0;
+		shard->cpu = cpu;
+		INIT_WORK(&shard->work, update_virtual_mem_buf);
+		shard->stage = kmalloc(SHARD_STAGE_RECORDS * sizeof(mp3_proc_sample), GFP_KERNEL);
+		shard->staged = 0;
+		shard->wss_next = 0;
 
-	regist_head = (mp3_list_entry*) kmem_cache_alloc(mp3_entry_slab, SLAB_PANIC);
-   	INIT_LIST_HEAD(list_head_ptr(regist_head));
-   	regist_head->pid = -1;
+		shard_count += 1;
+	}
+	put_online_cpus();
 
    	mp3_list_length = 0;
 
    	#ifdef DEBUG
-   	printk(KERN_ALERT "alloc [%p]\n", regist_head);
+   	printk(KERN_ALERT "alloc [%p] shards [%u]\n", shards, shard_count);
    	#endif
-
-   	spin_unlock(&list_lock);
 }
 
 // free the linked list
 void free_linked_list(void){
 	struct list_head *pos;
 	mp3_list_entry *this_entry;
+	unsigned i;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "free_linked_list called\n");
 	#endif
 
+	// the entries removed before are freed by rcu callbacks, wait for them
+	rcu_barrier();
+
 	spin_lock(&list_lock);
 
-	// my own version of traversal, free resource in place
-	for(pos = list_head_ptr(regist_head)->next; pos != list_head_ptr(regist_head);
-		/*increment is done in the loop body*/){
-		this_entry = (mp3_list_entry*) pos;
-		pos = pos->next;
+	for(i = 0; i < shard_count; i++){
+		// my own version of traversal, free resource in place
+		for(pos = shards[i].list.next; pos != &shards[i].list;
+			/*increment is done in the loop body*/){
+			this_entry = (mp3_list_entry*) pos;
+			pos = pos->next;
 
-		#ifdef DEBUG
-		printk(KERN_ALERT "free [%p]\n", this_entry);
-		#endif
+			#ifdef DEBUG
+			printk(KERN_ALERT "free [%p]\n", this_entry);
+			#endif
 
-		kmem_cache_free(mp3_entry_slab, this_entry);
+			// the work queue is gone already, no reader left
+			if(this_entry->suspended != 0){
+				_resume_entry(this_entry);
+			}
+			put_task_struct(this_entry->pcb_ptr);
+			kmem_cache_free(mp3_entry_slab, this_entry);
+		}
 	}
 
+	spin_unlock(&list_lock);
+
 	#ifdef DEBUG
-	printk(KERN_ALERT "free [%p]\n", regist_head);
+	printk(KERN_ALERT "free [%p]\n", shards);
 	#endif
-	// free the list head
-	kmem_cache_free(mp3_entry_slab, regist_head);
-
-	spin_unlock(&list_lock);
+	// free the shards
+	for(i = 0; i < shard_count; i++){
+		kfree(shards[i].stage);
+	}
+	kfree(shards);
 	// static variable list_lock automatically freed after the program terminates
 }
 
 
+// between 1 and the whole ring, otherwise a reader would never wake up before the period ends
+void _set_wake_threshold(unsigned threshold){
+	if(threshold < 1){
+		threshold = 1;
+	}
+	if(threshold > buf_header->capacity){
+		threshold = buf_header->capacity;
+	}
+	wake_threshold = threshold;
+
+	// readers waiting on the old threshold may be ready now
+	wake_up_interruptible(&mp3_read_wq);
+}
+
+
+// in ms, at least WQ_MIN_INTERVAL. It takes effect from the next deadline on
+void _set_sample_interval(unsigned interval){
+	if(interval < WQ_MIN_INTERVAL){
+		interval = WQ_MIN_INTERVAL;
+	}
+	WRITE_ONCE(sample_interval, interval);
+}
+
+/*
+
+	Fault Sites
+
+*/
+// off by default, shares the fault probe with the heatmap
+static bool fault_sites = false;
+module_param(fault_sites, bool, 0444);
+MODULE_PARM_DESC(fault_sites, "count the faults of the registered processes per user instruction pointer (default 0, x86_64 only)");
+
+static unsigned int sites_top = 32;
+module_param(sites_top, uint, 0444);
+MODULE_PARM_DESC(sites_top, "fault sites listed in /proc/mp3/sites (default 32)");
+
+#define SITE_SLOTS 		1024 // hash table slots, open addressing
+#define SITE_PROBES 	32 // slots looked at before a fault counts as dropped
+#define SITE_LINE_SIZE 	64
+
+typedef struct mp3_site_slot_t {
+	bool used;
+	int pid;
+	unsigned long ip;
+	u32 minor;
+	u32 major;
+} mp3_site_slot;
+static mp3_site_slot *site_table = NULL;
+static unsigned site_used = 0;
+static unsigned site_dropped = 0;
+static spinlock_t site_lock;
+
+// faults the probe could not see, defined with the probe
+unsigned long _fault_missed(void);
+
+// count one fault at the user instruction pointer it came from
+void _site_count(int pid, unsigned long ip, bool major){
+	mp3_site_slot *slot;
+	unsigned long flags;
+	unsigned index;
+	unsigned probe;
+
+	spin_lock_irqsave(&site_lock, flags);
+
+	slot = NULL;
+	index = hash_long(ip ^ pid, 32) % SITE_SLOTS;
+	for(probe = 0; probe < SITE_PROBES; probe++){
+		slot = &site_table[(index + probe) % SITE_SLOTS];
+		if(!slot->used || (slot->pid == pid && slot->ip == ip)){
+			break;
+		}
+		slot = NULL;
+	}
+
+	if(slot == NULL){
+		// the neighbourhood is full, the table is crowded
+		site_dropped += 1;
+		spin_unlock_irqrestore(&site_lock, flags);
+		return;
+	}
+
+	if(!slot->used){
+		slot->used = true;
+		slot->pid = pid;
+		slot->ip = ip;
+		site_used += 1;
+	}
+
+	if(major){
+		slot->major += 1;
+	}else{
+		slot->minor += 1;
+	}
+
+	spin_unlock_irqrestore(&site_lock, flags);
+}
+
+// most major faults first, then most minor faults
+static int _site_cmp(const void *a, const void *b){
+	const mp3_site_slot *site_a = a;
+	const mp3_site_slot *site_b = b;
+
+	if(site_a->major != site_b->major){
+		return site_a->major < site_b->major ? 1 : -1;
+	}
+	if(site_a->minor != site_b->minor){
+		return site_a->minor < site_b->minor ? 1 : -1;
+	}
+	return 0;
+}
+
+// the top sites_top sites, one "pid ip minor major" line each, then a comment line with the totals
+ssize_t read_fault_sites(char *buf, size_t buf_len){
+	mp3_site_slot *sites;
+	unsigned long flags;
+	unsigned count;
+	ssize_t total;
+	int i;
+
+	sites = vmalloc(SITE_SLOTS * sizeof(mp3_site_slot));
+	if(sites == NULL){
+		return 0;
+	}
+
+	// sort a copy, out of the lock
+	count = 0;
+	spin_lock_irqsave(&site_lock, flags);
+	for(i = 0; i < SITE_SLOTS; i++){
+		if(site_table[i].used){
+			sites[count++] = site_table[i];
+		}
+	}
+	spin_unlock_irqrestore(&site_lock, flags);
+	sort(sites, count, sizeof(mp3_site_slot), _site_cmp, NULL);
+
+	total = 0;
+	for(i = 0; i < count && i < sites_top; i++){
+		total += scnprintf(buf + total, buf_len - total, "%d 0x%lx %u %u\n",
+			sites[i].pid, sites[i].ip, sites[i].minor, sites[i].major);
+	}
+	total += scnprintf(buf + total, buf_len - total, "# %u sites, %lu faults not counted\n",
+		count, site_dropped + _fault_missed());
+
+	vfree(sites);
+	return total;
+}
+
+// forget every site
+void _site_reset(void){
+	unsigned long flags;
+
+	spin_lock_irqsave(&site_lock, flags);
+	memset(site_table, 0, SITE_SLOTS * sizeof(mp3_site_slot));
+	site_used = 0;
+	site_dropped = 0;
+	spin_unlock_irqrestore(&site_lock, flags);
+}
+
+
+/*
+
+	Fault Heatmap
+
+*/
+// off by default, the probe sees every page fault of the system
+static bool heatmap = false;
+module_param(heatmap, bool, 0444);
+MODULE_PARM_DESC(heatmap, "count the faults of the registered processes per VMA (default 0, x86_64 only)");
+
+#define HEAT_VMAS 		256 // hash table slots, open addressing
+#define FAULT_MAXACTIVE 	256 // faults in flight, major faults sleep on io
+
+// handle_mm_fault(mm, vma, address, flags): the arguments in the registers at the probe
+#ifdef CONFIG_X86_64
+#define FAULT_ARG_VMA(regs) 	((struct vm_area_struct*) (regs)->si)
+#define FAULT_ARG_ADDRESS(regs) ((regs)->dx)
+#endif
+
+typedef struct mp3_heat_slot_t {
+	bool used;
+	int pid;
+	int type;
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long bucket_size;
+	// a reference to the backing file, NULL for anonymous memory
+	struct file *file;
+	u32 minor[MP3_HEAT_BUCKETS];
+	u32 major[MP3_HEAT_BUCKETS];
+} mp3_heat_slot;
+static mp3_heat_slot *heat_table = NULL;
+static unsigned heat_used = 0;
+static unsigned heat_dropped = 0;
+static spinlock_t heat_lock;
+
+// what the entry handler saw, kept in the kretprobe instance until the fault returns
+typedef struct mp3_fault_data_t {
+	int pid;
+	int type;
+	unsigned long ip;
+	unsigned long address;
+	unsigned long vm_start;
+	unsigned long vm_end;
+	struct file *file;
+} mp3_fault_data;
+
+// the current process is registered, rcu_read_lock() is fine in a probe
+bool _tgid_registered(int tgid){
+	mp3_list_entry *this_entry;
+	bool found;
+
+	found = false;
+	rcu_read_lock();
+	list_for_each_entry_rcu(this_entry, &_pid_shard(tgid)->list, head){
+		if(this_entry->pid == tgid){
+			found = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+// the VMA type, like the names in /proc/<pid>/maps
+int _vma_type(struct vm_area_struct *vma){
+	if(vma->vm_file != NULL){
+		return MP3_HEAT_FILE;
+	}
+	if(vma->vm_mm != NULL && vma->vm_start <= vma->vm_mm->brk && vma->vm_end >= vma->vm_mm->start_brk){
+		return MP3_HEAT_HEAP;
+	}
+	if(vma->vm_flags & VM_GROWSDOWN){
+		return MP3_HEAT_STACK;
+	}
+	return MP3_HEAT_ANON;
+}
+
+// count one fault in the slot of its VMA, a new slot at the first fault
+void _heat_count(mp3_fault_data *data, bool major){
+	mp3_heat_slot *slot;
+	unsigned long flags;
+	unsigned long bucket;
+	unsigned index;
+	unsigned probe;
+
+	spin_lock_irqsave(&heat_lock, flags);
+
+	slot = NULL;
+	index = hash_long(data->vm_start ^ data->pid, 32) % HEAT_VMAS;
+	for(probe = 0; probe < HEAT_VMAS; probe++){
+		slot = &heat_table[(index + probe) % HEAT_VMAS];
+		if(!slot->used || (slot->pid == data->pid && slot->vm_start == data->vm_start)){
+			break;
+		}
+		slot = NULL;
+	}
+
+	if(slot == NULL){
+		// the heatmap is full
+		heat_dropped += 1;
+		spin_unlock_irqrestore(&heat_lock, flags);
+		return;
+	}
+
+	if(!slot->used){
+		slot->used = true;
+		slot->pid = data->pid;
+		slot->type = data->type;
+		slot->vm_start = data->vm_start;
+		slot->vm_end = data->vm_end;
+		slot->bucket_size = PAGE_ALIGN(DIV_ROUND_UP(data->vm_end - data->vm_start, MP3_HEAT_BUCKETS));
+		// the VMA holds the file during the fault
+		slot->file = data->file;
+		if(slot->file != NULL){
+			get_file(slot->file);
+		}
+		heat_used += 1;
+	}
+
+	// the VMA may have grown since the first fault
+	bucket = min_t(unsigned long, (data->address - slot->vm_start) / slot->bucket_size, MP3_HEAT_BUCKETS - 1);
+	if(major){
+		slot->major[bucket] += 1;
+	}else{
+		slot->minor[bucket] += 1;
+	}
+
+	spin_unlock_irqrestore(&heat_lock, flags);
+}
+
+#ifdef CONFIG_X86_64
+// a fault enters handle_mm_fault: keep what the return handler needs, or skip it for other processes
+static int _fault_entry(struct kretprobe_instance *ri, struct pt_regs *regs){
+	mp3_fault_data *data;
+	struct vm_area_struct *vma;
+
+	if(!_tgid_registered(current->tgid)){
+		return 1;
+	}
+
+	data = (mp3_fault_data*) ri->data;
+	vma = FAULT_ARG_VMA(regs);
+
+	data->pid = current->tgid;
+	data->type = _vma_type(vma);
+	// where the user code was: the faulting instruction, or the system call for a fault in copy_from_user
+	data->ip = instruction_pointer(task_pt_regs(current));
+	data->address = FAULT_ARG_ADDRESS(regs);
+	data->vm_start = vma->vm_start;
+	data->vm_end = vma->vm_end;
+	data->file = vma->vm_file;
+	return 0;
+}
+
+// the fault is handled: VM_FAULT_MAJOR tells a major fault
+static int _fault_return(struct kretprobe_instance *ri, struct pt_regs *regs){
+	mp3_fault_data *data;
+	unsigned long ret;
+
+	ret = regs_return_value(regs);
+	// a retry dropped mmap_sem, the file may be gone; it comes back as a new fault anyway
+	if(ret & (VM_FAULT_ERROR | VM_FAULT_RETRY)){
+		return 0;
+	}
+
+	data = (mp3_fault_data*) ri->data;
+	if(heatmap){
+		_heat_count(data, (ret & VM_FAULT_MAJOR) != 0);
+	}
+	if(fault_sites){
+		_site_count(data->pid, data->ip, (ret & VM_FAULT_MAJOR) != 0);
+	}
+	return 0;
+}
+#endif
+
+static struct kretprobe fault_kretprobe = {
+	.kp.symbol_name = "handle_mm_fault",
+	#ifdef CONFIG_X86_64
+	.entry_handler = _fault_entry,
+	.handler = _fault_return,
+	#endif
+	.data_size = sizeof(mp3_fault_data),
+	.maxactive = FAULT_MAXACTIVE,
+};
+
+unsigned long _fault_missed(void){
+	return fault_kretprobe.nmissed;
+}
+
+// forget every VMA, drop the file references
+void _heat_reset(void){
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&heat_lock, flags);
+	for(i = 0; i < HEAT_VMAS; i++){
+		if(heat_table[i].used && heat_table[i].file != NULL){
+			fput(heat_table[i].file);
+		}
+		memset(&heat_table[i], 0, sizeof(mp3_heat_slot));
+	}
+	heat_used = 0;
+	heat_dropped = 0;
+	spin_unlock_irqrestore(&heat_lock, flags);
+}
+
+// copy up to snapshot->capacity VMAs to the user records, with the paths of their files
+long _heat_snapshot(mp3_heat_snapshot *snapshot){
+	mp3_vma_heat *records;
+	struct file **files;
+	char *path_buf;
+	char *path;
+	unsigned long flags;
+	unsigned count;
+	unsigned capacity;
+	long ret;
+	int i;
+
+	capacity = min_t(unsigned, snapshot->capacity, HEAT_VMAS);
+	records = vzalloc(capacity * sizeof(mp3_vma_heat) + 1);
+	files = kcalloc(capacity + 1, sizeof(struct file*), GFP_KERNEL);
+	path_buf = (char*) __get_free_page(GFP_KERNEL);
+	if(records == NULL || files == NULL || path_buf == NULL){
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	// copy the counters, keep the files until their paths are resolved
+	count = 0;
+	spin_lock_irqsave(&heat_lock, flags);
+	for(i = 0; i < HEAT_VMAS && count < capacity; i++){
+		if(!heat_table[i].used){
+			continue;
+		}
+		records[count].pid = heat_table[i].pid;
+		records[count].type = heat_table[i].type;
+		records[count].vm_start = heat_table[i].vm_start;
+		records[count].vm_end = heat_table[i].vm_end;
+		records[count].bucket_size = heat_table[i].bucket_size;
+		memcpy(records[count].minor, heat_table[i].minor, sizeof(records[count].minor));
+		memcpy(records[count].major, heat_table[i].major, sizeof(records[count].major));
+		files[count] = heat_table[i].file;
+		if(files[count] != NULL){
+			get_file(files[count]);
+		}
+		count += 1;
+	}
+	snapshot->total = heat_used;
+	snapshot->dropped = heat_dropped + _fault_missed();
+	spin_unlock_irqrestore(&heat_lock, flags);
+
+	// d_path may sleep, out of the lock
+	for(i = 0; i < count; i++){
+		if(files[i] == NULL){
+			continue;
+		}
+		path = d_path(&files[i]->f_path, path_buf, PAGE_SIZE);
+		if(!IS_ERR(path)){
+			strlcpy(records[i].path, path, MP3_HEAT_PATH);
+		}
+		fput(files[i]);
+	}
+
+	snapshot->count = count;
+	ret = 0;
+	if(copy_to_user((void __user*) (unsigned long) snapshot->records, records, count * sizeof(mp3_vma_heat))){
+		ret = -EFAULT;
+	}
+
+out:
+	if(path_buf != NULL){
+		free_page((unsigned long) path_buf);
+	}
+	kfree(files);
+	vfree(records);
+	return ret;
+}
+
+// the tables & the probe, only with the heatmap or the fault_sites module parameter
+void _init_fault_probe(void){
+	int ret;
+
+	if(!heatmap && !fault_sites){
+		return;
+	}
+
+	#ifndef CONFIG_X86_64
+	printk(KERN_ALERT "fault probe: only on x86_64\n");
+	heatmap = false;
+	fault_sites = false;
+	return;
+	#endif
+
+	spin_lock_init(&heat_lock);
+	spin_lock_init(&site_lock);
+	if(heatmap){
+		heat_table = vzalloc(HEAT_VMAS * sizeof(mp3_heat_slot));
+	}
+	if(fault_sites){
+		site_table = vzalloc(SITE_SLOTS * sizeof(mp3_site_slot));
+	}
+	if((heatmap && heat_table == NULL) || (fault_sites && site_table == NULL)){
+		printk(KERN_ALERT "fault probe: no memory for the tables\n");
+		goto fail;
+	}
+
+	ret = register_kretprobe(&fault_kretprobe);
+	if(ret < 0){
+		printk(KERN_ALERT "fault probe: register_kretprobe failed [%d]\n", ret);
+		goto fail;
+	}
+	return;
+
+fail:
+	vfree(heat_table);
+	vfree(site_table);
+	heat_table = NULL;
+	site_table = NULL;
+	heatmap = false;
+	fault_sites = false;
+}
+
+// the probe first, so that no handler runs while the tables are freed
+void _destroy_fault_probe(void){
+	if(!heatmap && !fault_sites){
+		return;
+	}
+
+	unregister_kretprobe(&fault_kretprobe);
+	if(heatmap){
+		_heat_reset();
+	}
+	vfree(heat_table);
+	vfree(site_table);
+}
+
+
 /*
 
 	Proc File System & Slabs
@@ -469,6 +2075,8 @@ static ssize_t mp3_proc_read(struct file* file, char __user* buffer, size_t coun
 static ssize_t mp3_proc_write(struct file* file, const char __user* buffer, size_t count, loff_t* data){
 	char *buf;
 	int pid_int;
+	unsigned threshold;
+	unsigned interval;
 
 	#ifdef DEBUG
 	printk(KERN_ALERT "mp3_proc_write called\n");
@@ -500,6 +2108,18 @@ static ssize_t mp3_proc_write(struct file* file, const char __user* buffer, size
 		#endif
 
 		unregister_process(pid_int);
+	}else if(sscanf(buf, CMD_FORMAT_THRESHOLD, &threshold) == 1){
+		#ifdef DEBUG
+		printk(KERN_ALERT "wake threshold [%u]\n", threshold);
+		#endif
+
+		_set_wake_threshold(threshold);
+	}else if(sscanf(buf, CMD_FORMAT_INTERVAL, &interval) == 1){
+		#ifdef DEBUG
+		printk(KERN_ALERT "sample interval [%u]\n", interval);
+		#endif
+
+		_set_sample_interval(interval);
 	}
 	// do nothing if error formatted input
 
@@ -514,15 +2134,58 @@ static const struct file_operations mp3_proc_file_callbacks = {
    .write = mp3_proc_write
 };
 
+// the top fault sites, read only. Writing anything clears them
+static ssize_t mp3_sites_read(struct file* file, char __user* buffer, size_t count, loff_t* offset){
+	char *buf;
+	size_t buf_len;
+	ssize_t total;
+
+	if(*offset == PROC_READ_DONE){
+		*offset = PROC_UNREAD;
+		return 0;
+	}
+
+	buf_len = (min_t(size_t, sites_top, SITE_SLOTS) + 1) * SITE_LINE_SIZE;
+	buf = (char*) kmalloc(buf_len, GFP_KERNEL);
+	if(buf == NULL){
+		return -ENOMEM;
+	}
+	total = min_t(ssize_t, read_fault_sites(buf, buf_len), count);
+	if(copy_to_user(buffer, buf, total)){
+		total = -EFAULT;
+	}
+	kfree(buf);
+
+	*offset = PROC_READ_DONE;
+	return total;
+}
+
+static ssize_t mp3_sites_write(struct file* file, const char __user* buffer, size_t count, loff_t* data){
+	_site_reset();
+	return count;
+}
+
+static const struct file_operations mp3_sites_file_callbacks = {
+   .owner = THIS_MODULE,
+   .read = mp3_sites_read,
+   .write = mp3_sites_write
+};
+
 // make proc file
 void _create_proc_mp3_status(void){
 	mp3_proc_dir = proc_mkdir(PROC_DIR_NAME, NULL);
 	mp3_proc_entry = proc_create(PROC_FILE_NAME, 0666, mp3_proc_dir, &mp3_proc_file_callbacks);
+	if(fault_sites){
+		mp3_sites_entry = proc_create(PROC_SITES_NAME, 0644, mp3_proc_dir, &mp3_sites_file_callbacks);
+	}
 }
 
 // remove the proc file
 void _delete_proc_mp3_status(void){
    	remove_proc_entry(PROC_FILE_NAME, mp3_proc_dir);
+   	if(mp3_sites_entry != NULL){
+   		remove_proc_entry(PROC_SITES_NAME, mp3_proc_dir);
+   	}
    	remove_proc_entry(PROC_DIR_NAME, NULL);
 }
 
@@ -535,19 +2198,20 @@ void _init_mp3_memory(void){
 	mp3_write_buf_slab = kmem_cache_create("write_buf", PROC_WRITE_BUF_SIZE,
 		PROC_WRITE_BUF_SIZE, SLAB_PANIC, NULL);
 
+	// the header page & at least one page of records
+	buf_pages = clamp_t(unsigned, buf_pages, MP3_BUF_MIN_PAGES, MP3_BUF_MAX_PAGES);
+
 	// NOTE: vmalloc is page-aligned
-	virtual_mem_buf = vmalloc(VIRTUAL_BUF_SIZE);
+	virtual_mem_buf = vmalloc(buf_pages * VM_PAGE_SIZE);
 
 	// set PG_reserved, so that these pages won't be swapped out
-	for(page_id = 0; page_id < VIRTUAL_BUF_PAGE_NUM; page_id++){
+	for(page_id = 0; page_id < buf_pages; page_id++){
 		this_page = vmalloc_to_page(virtual_mem_buf + page_id * VM_PAGE_SIZE);
 		SetPageReserved(this_page);
 	}
 
-	// init the sampling variables and the vmalloced memory
-	sampling_count = 0;
-	sampling_position_ptr = (unsigned long*) virtual_mem_buf;
-	_report_terminate();
+	// init the header & the empty ring
+	_ring_init();
 }
 
 // free all the used slabs
@@ -559,7 +2223,7 @@ void _destroy_mp3_memory(void){
 	kmem_cache_destroy(mp3_write_buf_slab);
 
 	// clear PG_reserved to swap out the page
-	for(page_id = 0; page_id < VIRTUAL_BUF_PAGE_NUM; page_id++){
+	for(page_id = 0; page_id < buf_pages; page_id++){
 		this_page = vmalloc_to_page(virtual_mem_buf + page_id * VM_PAGE_SIZE);
 		ClearPageReserved(this_page);
 	}
@@ -573,14 +2237,152 @@ void _destroy_mp3_memory(void){
 	Character Devices
 
 */
-// nothing for open and release
+// per open file: the sequence number of the last measurement period end this reader was told about
+typedef struct mp3_reader_t {
+	u32 seen_seq;
+} mp3_reader;
+
 static int device_open(struct inode *inode, struct file *filp){
+	mp3_reader *reader;
+
+	reader = kmalloc(sizeof(mp3_reader), GFP_KERNEL);
+	if(reader == NULL){
+		return -ENOMEM;
+	}
+	// periods ended before the open are not reported
+	reader->seen_seq = smp_load_acquire(&buf_header->seq);
+
+	filp->private_data = reader;
 	return 0;
 }
 static int device_release(struct inode *inode, struct file *filp){
+	kfree(filp->private_data);
   	return 0;
 }
 
+// a measurement period ended since this reader last got end of file
+bool _period_ended(mp3_reader *reader){
+	u32 seq;
+
+	seq = smp_load_acquire(&buf_header->seq);
+	return (seq & 1) == 0 && seq != reader->seen_seq;
+}
+
+// enough samples to wake up for, or the period ended (then whatever is left, even nothing)
+bool _device_ready(mp3_reader *reader){
+	bool ended;
+	u32 ready;
+
+	// seq before head: the period ends after its last record
+	ended = _period_ended(reader);
+	ready = smp_load_acquire(&buf_header->head) - READ_ONCE(buf_header->tail);
+
+	return ready >= wake_threshold || ended;
+}
+
+// consume whole records from the ring, the same tail the mmap consumers use.
+// Blocks until the device is ready, then returns 0 once for each measurement period end with nothing left
+static ssize_t device_read(struct file *filp, char __user *buffer, size_t count, loff_t *offset){
+	mp3_reader *reader;
+	u32 head;
+	u32 tail;
+	size_t total;
+	size_t records;
+	size_t span;
+	int ret;
+
+	reader = filp->private_data;
+
+	if(count < buf_header->record_size){
+		return -EINVAL;
+	}
+
+	while(1){
+		if(!_device_ready(reader)){
+			if(filp->f_flags & O_NONBLOCK){
+				return -EAGAIN;
+			}
+			ret = wait_event_interruptible(mp3_read_wq, _device_ready(reader));
+			if(ret != 0){
+				return ret;
+			}
+		}
+
+		mutex_lock(&mp3_read_mutex);
+
+		head = smp_load_acquire(&buf_header->head);
+		tail = buf_header->tail;
+		total = 0;
+
+		// whole records, in at most two spans since the ring may wrap
+		records = min_t(size_t, head - tail, count / buf_header->record_size);
+		while(records > 0){
+			span = min_t(size_t, records, buf_header->capacity - (tail & (buf_header->capacity - 1)));
+			if(copy_to_user(buffer + total, _ring_slot(tail), span * buf_header->record_size)){
+				break;
+			}
+			total += span * buf_header->record_size;
+			tail += span;
+			records -= span;
+		}
+		// hand the slots back to the module
+		smp_store_release(&buf_header->tail, tail);
+
+		mutex_unlock(&mp3_read_mutex);
+
+		if(total > 0){
+			return total;
+		}
+		if(tail != head){
+			// copy_to_user failed on the first record
+			return -EFAULT;
+		}
+		if(_period_ended(reader)){
+			// nothing left & the period ended, end of file for this period
+			reader->seen_seq = smp_load_acquire(&buf_header->seq);
+			return 0;
+		}
+		// an mmap consumer took the samples first, wait again
+	}
+}
+
+// the fault heatmap: a snapshot into the user records, or a reset
+static long device_ioctl(struct file *filp, unsigned int cmd, unsigned long arg){
+	mp3_heat_snapshot snapshot;
+	long ret;
+
+	if(!heatmap){
+		return -ENODEV;
+	}
+
+	switch(cmd){
+		case MP3_IOC_HEAT_SNAPSHOT:
+			if(copy_from_user(&snapshot, (void __user*) arg, sizeof(snapshot))){
+				return -EFAULT;
+			}
+			ret = _heat_snapshot(&snapshot);
+			if(ret == 0 && copy_to_user((void __user*) arg, &snapshot, sizeof(snapshot))){
+				ret = -EFAULT;
+			}
+			return ret;
+		case MP3_IOC_HEAT_RESET:
+			_heat_reset();
+			return 0;
+		default:
+			return -ENOTTY;
+	}
+}
+
+// readable under the same condition read() would not block
+static unsigned int device_poll(struct file *filp, poll_table *wait){
+	poll_wait(filp, &mp3_read_wq, wait);
+
+	if(_device_ready(filp->private_data)){
+		return POLLIN | POLLRDNORM;
+	}
+	return 0;
+}
+
 // tricks for mmap
 static int device_mmap(struct file *inode, struct vm_area_struct *vma){
 	int page_id;
@@ -590,9 +2392,9 @@ static int device_mmap(struct file *inode, struct vm_area_struct *vma){
 	printk(KERN_ALERT "device_mmap called\n");
 	#endif
 
-	for(page_id = 0; page_id < VIRTUAL_BUF_PAGE_NUM; page_id++){
+	for(page_id = 0; page_id < buf_pages; page_id++){
 		// if not enought virtual memory left
-		if(vma->vm_start + page_id * VM_PAGE_SIZE + VM_PAGE_SIZE >= vma->vm_end){
+		if(vma->vm_start + page_id * VM_PAGE_SIZE + VM_PAGE_SIZE > vma->vm_end){
 			break;
 		}
 
@@ -608,6 +2410,9 @@ static int device_mmap(struct file *inode, struct vm_area_struct *vma){
 static const struct file_operations char_dev_ops = {
 	.owner = THIS_MODULE,
 	.mmap = device_mmap,
+	.read = device_read,
+	.poll = device_poll,
+	.unlocked_ioctl = device_ioctl,
 	.open = device_open,
 	.release = device_release
 };
@@ -650,6 +2455,8 @@ int __init mp3_init(void){
 
 	init_linked_list();
 
+	_init_fault_probe();
+
 	_create_proc_mp3_status();
 
 	_init_char_dev();
@@ -673,6 +2480,8 @@ void __exit mp3_exit(void){
 
 	_delete_proc_mp3_status();
 
+	_destroy_fault_probe();
+
 	free_linked_list();
 
 	_destroy_mp3_memory();
@@ -0,0 +1,190 @@
+#ifndef __MP3_BUF_INCLUDE__
+#define __MP3_BUF_INCLUDE__
+
+/*
+
+	The layout of the profiler buffer shared by mp3.c and the user space consumers (monitor.c).
+
+	Page 0 is the header, pages 1 to 3 the rollups (MP3_ROLLUP_*), the rest is a single-producer/single-consumer ring of fixed size records:
+	one mp3_sample per sampling round in the aggregate mode, one mp3_proc_sample per live process
+	and round in the per-process mode. In the encoded mode, the records are bytes (record_size 1)
+	and the aggregate samples are a stream of variable length records, see MP3_ENC_*.
+	The size of the buffer is set when the module is loaded.
+	head and tail are free running record counters: the module only writes head, the consumer only
+	writes tail, and (head - tail) records are ready at index tail & (capacity - 1). capacity is a
+	power of two, so the index stays in order when the counters wrap around 2^32. Both are published
+	with release stores and read with acquire loads, so a record is complete before its index shows up.
+
+*/
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define MP3_BUF_MAGIC		0x4d503342	// "MP3B"
+#define MP3_BUF_VERSION		8
+
+// 128 * 4KB memory buffer by default, the first page is the header, then the rollups
+#define MP3_BUF_PAGE_NUM	128
+#define MP3_BUF_MIN_PAGES	5
+#define MP3_BUF_MAX_PAGES	65536	// 256MB
+#define MP3_BUF_PAGE_SIZE	4096
+#define MP3_BUF_ROLLUP_OFFSET	MP3_BUF_PAGE_SIZE
+#define MP3_BUF_DATA_OFFSET	(4 * MP3_BUF_PAGE_SIZE)
+
+// record modes
+#define MP3_MODE_AGGREGATE	0
+#define MP3_MODE_PROCESS	1
+#define MP3_MODE_ENCODED	2
+
+typedef struct mp3_buf_header_t {
+	__u32 magic;
+	__u32 version;
+	__u32 record_size;	// bytes per record
+	__u32 capacity;		// records in the ring, a power of two
+
+	__u32 head;		// records written, module only
+	__u32 tail;		// records consumed, consumer only
+	// measurement periods: bumped when one starts and when it ends, odd while one is running
+	__u32 seq;
+	// records not written because the consumer left no room
+	__u32 dropped;
+
+	__u32 pages;		// the whole buffer, header included, to mmap
+	__u32 mode;		// MP3_MODE_*
+} mp3_buf_header;
+
+// one sample, every sampling interval
+typedef struct mp3_sample_t {
+	__u64 jiffies;
+	__u64 min_flt;
+	__u64 maj_flt;
+	__u64 cpu_time;		// utime + stime during the interval
+	__u64 timestamp_ns;	// when it was taken, CLOCK_MONOTONIC
+	__u32 missed;		// deadlines before this one without a sample of their own
+	__u32 late_us;		// how long after its deadline it was taken
+} mp3_sample;
+
+// one live process in one sampling round, 100 processes at 20Hz take 48KB/s. The counters are
+// the deltas of the interval, saturated. The time is CLOCK_MONOTONIC in ms, wrapping after 49 days
+typedef struct mp3_proc_sample_t {
+	__u32 time_ms;
+	__u32 pid;
+	__u32 min_flt;
+	__u16 maj_flt;
+	__u16 cpu_time;		// utime + stime during the interval, as in mp3_sample
+	// working set (wss_window module parameter, 0 otherwise): the pages touched in the last
+	// complete scan window & the change from the window before, updated when a scan pass ends
+	__u32 wss_pages;
+	__s32 wss_delta;
+} mp3_proc_sample;
+
+/*
+	The encoded mode: every field is an unsigned LEB128 varint, signed ones are zigzag encoded first.
+	A record starts with a tag, (value << MP3_ENC_TYPE_BITS) | type, then the fields of its type:
+
+	MP3_ENC_KEY: value is the sampling interval (us), then timestamp_ns, jiffies, min_flt, maj_flt,
+		cpu_time, missed, late_us, all absolute. At the start of every measurement period, after a
+		dropped record & when the interval changes
+	MP3_ENC_ROW: value is zigzag(timestamp delta (us) - interval), then the jiffies delta, min_flt,
+		maj_flt, cpu_time, missed, late_us
+	MP3_ENC_RUN: value is a count of idle rows (no faults, no cpu time, nothing missed), then
+		zigzag(timestamp delta (us) - count * interval) & the jiffies delta up to the last of them.
+		Their own timestamps & lateness are not kept, a decoder spreads them evenly
+	MP3_ENC_EVENT: value is an MP3_EVENT_*, then the pid, major faults/s & cpu utilization (%).
+		It happened at the time of the record before, the deltas still count from that one
+
+	The deltas are from the previous record, in whole us, so both sides round the same way.
+	The module only publishes whole records, a reader of the device may get a part of one.
+*/
+#define MP3_ENC_ROW		0
+#define MP3_ENC_RUN		1
+#define MP3_ENC_KEY		2
+#define MP3_ENC_EVENT		3
+#define MP3_ENC_TYPE_BITS	2
+#define MP3_ENC_MAX_RUN		256
+#define MP3_ENC_MAX_RECORD	96	// bytes, 8 varints of at most 10 bytes
+
+/*
+	Rollups: the aggregate counters of every sampling round, whatever the record mode, summed up in
+	windows of 1s, 10s & 1min, aligned to the resolution on CLOCK_MONOTONIC. Each level is a ring of
+	MP3_ROLLUP_SLOTS windows, so 1min, 10min & 1h of history in 12KB, across measurement periods.
+
+	slots[head % MP3_ROLLUP_SLOTS] is the window being filled, the ones before it are complete.
+	A window without any sample gets no slot, start_ns tells which window a slot is. The module bumps
+	seq before & after it changes a slot, a reader copies the slot while seq is even and the same.
+	A new window is reset under an odd seq before head moves to it, so it never shows the old one.
+*/
+#define MP3_ROLLUP_LEVELS	3
+#define MP3_ROLLUP_SLOTS	60
+#define MP3_ROLLUP_RES_MS	{ 1000, 10000, 60000 }
+
+// the counters of a slot
+#define MP3_ROLLUP_MIN_FLT	0
+#define MP3_ROLLUP_MAJ_FLT	1
+#define MP3_ROLLUP_CPU_TIME	2
+#define MP3_ROLLUP_COUNTERS	3
+
+typedef struct mp3_rollup_slot_t {
+	__u64 start_ns;
+	__u64 sum[MP3_ROLLUP_COUNTERS];
+	__u64 max[MP3_ROLLUP_COUNTERS];	// the largest sample
+	__u32 count;			// samples
+	__u32 seq;
+} mp3_rollup_slot;
+
+typedef struct mp3_rollup_t {
+	__u32 resolution_ms;
+	__u32 head;		// module only, release stores
+	__u64 reserved;
+	mp3_rollup_slot slots[MP3_ROLLUP_SLOTS];
+} mp3_rollup;
+
+/*
+	Load control events (load_control module parameter), in the same stream as the samples:
+	MP3_MODE_AGGREGATE: an mp3_sample with jiffies MP3_EVENT_MARK, missed is the event, min_flt the pid,
+		maj_flt the major faults/s, cpu_time the cpu utilization (%), timestamp_ns when it happened
+	MP3_MODE_PROCESS: an mp3_proc_sample with pid 0, maj_flt is the event, min_flt the pid,
+		wss_pages the major faults/s, cpu_time the cpu utilization (%), time_ms when it happened
+	MP3_MODE_ENCODED: an MP3_ENC_EVENT record
+*/
+#define MP3_EVENT_MARK		((__u64) -1)
+#define MP3_EVENT_SUSPEND	1	// the process got SIGSTOP
+#define MP3_EVENT_RESUME	2	// the process got SIGCONT
+
+/*
+	The fault heatmap (heatmap module parameter): the faults of the registered processes per VMA,
+	in MP3_HEAT_BUCKETS equal ranges of pages, taken as a snapshot with an ioctl on the device.
+*/
+#define MP3_HEAT_BUCKETS	64
+#define MP3_HEAT_PATH		128
+
+// VMA types
+#define MP3_HEAT_ANON		0
+#define MP3_HEAT_FILE		1	// path is the backing file
+#define MP3_HEAT_HEAP		2
+#define MP3_HEAT_STACK		3
+
+typedef struct mp3_vma_heat_t {
+	__u32 pid;
+	__u32 type;
+	__u64 vm_start;
+	__u64 vm_end;		// when the first fault was counted
+	__u64 bucket_size;	// bytes, a multiple of the page size
+	__u32 minor[MP3_HEAT_BUCKETS];
+	__u32 major[MP3_HEAT_BUCKETS];
+	char path[MP3_HEAT_PATH];
+} mp3_vma_heat;
+
+typedef struct mp3_heat_snapshot_t {
+	__u64 records;		// in: user pointer to capacity records
+	__u32 capacity;		// in
+	__u32 count;		// out: records filled
+	__u32 total;		// out: VMAs in the heatmap, may be more than capacity
+	__u32 dropped;		// out: faults not counted, the heatmap was full or the probe missed them
+} mp3_heat_snapshot;
+
+#define MP3_IOC_MAGIC		'm'
+#define MP3_IOC_HEAT_SNAPSHOT	_IOWR(MP3_IOC_MAGIC, 1, mp3_heat_snapshot)
+#define MP3_IOC_HEAT_RESET	_IO(MP3_IOC_MAGIC, 2)
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef __MP3_STREAM_INCLUDE__
+#define __MP3_STREAM_INCLUDE__
+
+/*
+
+	The user space side of the profiler stream, shared by monitor.c, collect.c & analyze.c.
+
+	collect writes a file of one mp3_stream_header, then the records of the ring as they are,
+	in the layout of the mode, see mp3_buf.h. The decoder turns the byte stream of the encoded
+	mode back into rows & events.
+
+*/
+
+#include <string.h>
+
+#include "mp3_buf.h"
+
+#define MP3_STREAM_MAGIC	0x4d503353	// "MP3S"
+
+typedef struct mp3_stream_header_t {
+	__u32 magic;
+	__u32 version;		// MP3_BUF_VERSION of the module that wrote the records
+	__u32 mode;		// MP3_MODE_*
+	__u32 record_size;
+} mp3_stream_header;
+
+// one aggregate sample, as in mp3_sample
+typedef struct mp3_row_t {
+	__u64 jiffies;
+	__u64 min_flt;
+	__u64 maj_flt;
+	__u64 cpu_time;
+	__u64 timestamp_ns;
+	__u32 missed;
+	__u32 late_us;
+} mp3_row;
+
+typedef void (*mp3_row_fn)(const mp3_row *row, void *arg);
+typedef void (*mp3_event_fn)(__u32 event, __u32 pid, __u64 maj_rate, __u64 cpu_pct, __u64 timestamp_ns, void *arg);
+
+/*
+	The decoder of the encoded mode, see MP3_ENC_* in mp3_buf.h. It is fed one byte at a time, so a record may
+	span two reads. Until the first key record, timestamps & jiffies count from 0.
+*/
+typedef struct mp3_decoder_t {
+	__u64 fields[8];
+	int count;
+	int expected;
+	__u64 value;
+	int shift;
+
+	__u64 prev_ns;
+	__u64 prev_jiffies;
+	__u64 interval_us;
+
+	mp3_row_fn on_row;
+	mp3_event_fn on_event;
+	void *arg;
+} mp3_decoder;
+
+static inline void mp3_decoder_init(mp3_decoder *dec, mp3_row_fn on_row, mp3_event_fn on_event, void *arg){
+	memset(dec, 0, sizeof(mp3_decoder));
+	dec->on_row = on_row;
+	dec->on_event = on_event;
+	dec->arg = arg;
+}
+
+static inline __s64 mp3_unzigzag(__u64 value){
+	return (__s64) (value >> 1) ^ -(__s64) (value & 1);
+}
+
+static inline void mp3_emit_row(mp3_decoder *dec, __u64 jiffies, __u64 min_flt, __u64 maj_flt, __u64 cpu_time,
+	__u64 timestamp_ns, __u64 missed, __u64 late_us){
+	mp3_row row;
+
+	row.jiffies = jiffies;
+	row.min_flt = min_flt;
+	row.maj_flt = maj_flt;
+	row.cpu_time = cpu_time;
+	row.timestamp_ns = timestamp_ns;
+	row.missed = (__u32) missed;
+	row.late_us = (__u32) late_us;
+	dec->on_row(&row, dec->arg);
+}
+
+// a whole record is in dec->fields, emit its rows & return how many, -1 for an unknown record
+static inline long mp3_decode_record(mp3_decoder *dec){
+	__u64 tag = dec->fields[0] >> MP3_ENC_TYPE_BITS;
+	__u64 *f = dec->fields;
+	__s64 delta_ns;
+	__u64 delta_jiffies;
+	__u64 n;
+
+	switch(f[0] & ((1 << MP3_ENC_TYPE_BITS) - 1)){
+		case MP3_ENC_KEY:
+			dec->interval_us = tag;
+			dec->prev_ns = f[1];
+			dec->prev_jiffies = f[2];
+			mp3_emit_row(dec, f[2], f[3], f[4], f[5], f[1], f[6], f[7]);
+			return 1;
+
+		case MP3_ENC_ROW:
+			dec->prev_ns += (dec->interval_us + mp3_unzigzag(tag)) * 1000;
+			dec->prev_jiffies += f[1];
+			mp3_emit_row(dec, dec->prev_jiffies, f[2], f[3], f[4], dec->prev_ns, f[5], f[6]);
+			return 1;
+
+		case MP3_ENC_RUN:
+			// idle rows, spread evenly up to the last one
+			delta_ns = ((__s64) (tag * dec->interval_us) + mp3_unzigzag(f[1])) * 1000;
+			delta_jiffies = f[2];
+			for(n = 1; n <= tag; n++){
+				mp3_emit_row(dec, dec->prev_jiffies + delta_jiffies * n / tag, 0, 0, 0, dec->prev_ns + delta_ns * n / tag, 0, 0);
+			}
+			dec->prev_ns += delta_ns;
+			dec->prev_jiffies += delta_jiffies;
+			return tag;
+
+		case MP3_ENC_EVENT:
+			if(dec->on_event != NULL){
+				dec->on_event((__u32) tag, (__u32) f[1], f[2], f[3], dec->prev_ns, dec->arg);
+			}
+			return 0;
+	}
+
+	return -1;
+}
+
+// one byte of the encoded stream, return the rows it completed
+static inline long mp3_decode_byte(mp3_decoder *dec, unsigned char byte){
+	dec->value |= (__u64) (byte & 0x7f) << dec->shift;
+	dec->shift += 7;
+	if(byte & 0x80){
+		return 0;
+	}
+
+	dec->fields[dec->count++] = dec->value;
+	dec->value = 0;
+	dec->shift = 0;
+
+	// the tag tells how many fields follow
+	if(dec->count == 1){
+		switch(dec->fields[0] & ((1 << MP3_ENC_TYPE_BITS) - 1)){
+			case MP3_ENC_KEY: dec->expected = 8; break;
+			case MP3_ENC_ROW: dec->expected = 7; break;
+			case MP3_ENC_EVENT: dec->expected = 4; break;
+			default: dec->expected = 3; break;
+		}
+	}
+	if(dec->count < dec->expected){
+		return 0;
+	}
+
+	dec->count = 0;
+	return mp3_decode_record(dec);
+}
+
+#endif
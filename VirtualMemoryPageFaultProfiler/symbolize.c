@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+
+	symbolize: resolves the fault sites of /proc/mp3/sites against /proc/<pid>/maps
+
+	usage: ./symbolize [sites file]
+
+	Every "pid ip minor major" line is printed again with the mapping that holds ip:
+	its path and the offset of ip in the file, ready for addr2line -e <path> <offset>
+	(for position independent code) or for a look at the disassembly. Run it while the
+	processes are still alive, the mappings of an exited process are gone.
+
+*/
+
+#define DEFAULT_SITES "/proc/mp3/sites"
+
+#define LINE_SIZE 512
+#define PATH_SIZE 256
+
+// the mapping of pid that holds ip: its path & the offset of ip in the file, non-zero if found
+int resolve_ip(int pid, unsigned long ip, char* path, unsigned long* file_offset){
+	char maps_name[PATH_SIZE];
+	char line[LINE_SIZE];
+	unsigned long start;
+	unsigned long end;
+	unsigned long offset;
+	int path_pos;
+	FILE* maps;
+	int found;
+
+	sprintf(maps_name, "/proc/%d/maps", pid);
+	maps = fopen(maps_name, "r");
+	if(maps == NULL){
+		return 0;
+	}
+
+	found = 0;
+	while(!found && fgets(line, LINE_SIZE, maps) != NULL){
+		// start-end perms offset dev inode [path]
+		path_pos = 0;
+		if(sscanf(line, "%lx-%lx %*s %lx %*s %*s %n", &start, &end, &offset, &path_pos) < 3){
+			continue;
+		}
+		if(ip < start || ip >= end){
+			continue;
+		}
+
+		found = 1;
+		line[strcspn(line, "\n")] = '\0';
+		if(path_pos == 0 || line[path_pos] == '\0'){
+			strcpy(path, "[anon]");
+		}else{
+			strncpy(path, line + path_pos, PATH_SIZE - 1);
+			path[PATH_SIZE - 1] = '\0';
+		}
+		*file_offset = ip - start + offset;
+	}
+
+	fclose(maps);
+	return found;
+}
+
+int main(int argc, char* argv[]){
+	char line[LINE_SIZE];
+	char path[PATH_SIZE];
+	char* sites_name;
+	unsigned long ip;
+	unsigned long file_offset;
+	unsigned int minor;
+	unsigned int major;
+	int pid;
+	FILE* sites;
+
+	sites_name = DEFAULT_SITES;
+	if(argc > 1){
+		sites_name = argv[1];
+	}
+
+	sites = fopen(sites_name, "r");
+	if(sites == NULL){
+		printf("can not open %s, is the module loaded with fault_sites=1?\n", sites_name);
+		return 1;
+	}
+
+	printf("pid ip minor major path offset\n");
+	while(fgets(line, LINE_SIZE, sites) != NULL){
+		// the totals line
+		if(line[0] == '#'){
+			printf("%s", line);
+			continue;
+		}
+		if(sscanf(line, "%d %lx %u %u", &pid, &ip, &minor, &major) != 4){
+			continue;
+		}
+
+		if(resolve_ip(pid, ip, path, &file_offset)){
+			printf("%d 0x%lx %u %u %s 0x%lx\n", pid, ip, minor, major, path, file_offset);
+		}else{
+			// exited, or ip is not in any mapping any more
+			printf("%d 0x%lx %u %u ? ?\n", pid, ip, minor, major);
+		}
+	}
+
+	fclose(sites);
+	return 0;
+}